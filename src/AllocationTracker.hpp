@@ -0,0 +1,280 @@
+#pragma once
+
+#include "falk/defs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#if defined(__unix__) or defined(__APPLE__)
+   #include <sys/resource.h>
+   #include <unistd.h>
+#endif
+
+// Opt-in tracking of C++ heap allocations (the idea of stb_leakcheck.h, for operator new/delete
+// and thread-safe). When DV1478_TRACK_ALLOCATIONS is defined, the global operator new/delete are
+// replaced by versions that keep process-wide counters of allocations and live bytes. Stages
+// (DV_PROFILE_ZONE in falk/Profiler.hpp opens one) additionally record how many allocations and
+// bytes they made and how far they raised the live heap above its level at their start.
+// Stages only see the thread that opens them (its state is thread_local), so stages on concurrent
+// threads do not disturb each other. ThreadPool workers open a pool stage for each job, under the
+// name of the stage that started it; the report lists that work in a "(pool workers)" row below it.
+// Like the stb libraries, exactly one translation unit must define
+// DV1478_ALLOCATION_TRACKER_IMPLEMENTATION before including this header.
+namespace AllocationTracker {
+#ifdef DV1478_TRACK_ALLOCATIONS
+   Bool constexpr is_enabled = true;
+#else
+   Bool constexpr is_enabled = false;
+#endif
+
+   struct Counters {
+      U64 allocations   = 0,
+          deallocations = 0,
+          bytes         = 0; // total bytes allocated
+   };
+
+   struct StageStats {
+      char const  *name;
+      U64          calls       = 0,
+                   allocations = 0,
+                   bytes       = 0,
+                   peak_growth = 0, // highest live bytes above the level at the stage's start
+                   // made by pool workers for the stage's jobs; the peak is per worker and job
+                   pool_allocations = 0,
+                   pool_bytes       = 0,
+                   pool_peak_growth = 0;
+   };
+
+   namespace detail {
+      inline std::atomic<U64>  allocations   = 0,
+                               deallocations = 0,
+                               bytes         = 0,
+                               live_bytes    = 0,
+                               peak_bytes    = 0; // highest live_bytes ever
+
+      // what the stages of one thread see; net_bytes goes negative when the thread frees
+      // memory that another one allocated
+      struct ThreadCounters {
+         U64 allocations = 0,
+             bytes       = 0;
+         I64 net_bytes   = 0,
+             stage_peak  = 0; // highest net_bytes since the thread's innermost stage began
+      };
+
+      inline thread_local ThreadCounters this_thread;
+      inline thread_local char const    *open_stage = nullptr; // the name of the thread's innermost stage
+
+      inline void raise( std::atomic<U64> &peak, U64 value ) {
+         for ( U64 current = peak.load(std::memory_order_relaxed);
+               value > current and not peak.compare_exchange_weak(current, value, std::memory_order_relaxed); );
+      }
+
+      inline void on_allocate( Size size ) {
+         allocations.fetch_add( 1, std::memory_order_relaxed );
+         bytes.fetch_add( size, std::memory_order_relaxed );
+         U64 const live = live_bytes.fetch_add( size, std::memory_order_relaxed ) + size;
+         raise( peak_bytes, live );
+         auto &counters = this_thread;
+         counters.allocations += 1;
+         counters.bytes       += size;
+         counters.net_bytes   += I64( size );
+         counters.stage_peak   = std::max( counters.stage_peak, counters.net_bytes );
+      }
+
+      inline void on_deallocate( Size size ) {
+         deallocations.fetch_add( 1, std::memory_order_relaxed );
+         live_bytes.fetch_sub( size, std::memory_order_relaxed );
+         this_thread.net_bytes -= I64( size );
+      }
+
+      inline std::mutex & stages_mutex() {
+         static std::mutex mutex;
+         return mutex;
+      }
+
+      inline Vec<StageStats> & stages() { // in order of first use
+         static Vec<StageStats> stages;
+         return stages;
+      }
+   }
+
+   inline Counters counters() {
+      return { detail::allocations.load(), detail::deallocations.load(), detail::bytes.load() };
+   }
+
+   inline U64 live_bytes() {
+      return detail::live_bytes.load();
+   }
+
+   inline U64 peak_bytes() {
+      return detail::peak_bytes.load();
+   }
+
+   // peak resident set size of the process in bytes (0 if unknown); includes non-heap memory
+   inline U64 peak_rss_bytes() {
+   #if defined(__unix__) or defined(__APPLE__)
+      rusage usage;
+      if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+      #ifdef __APPLE__
+         return U64( usage.ru_maxrss );        // bytes
+      #else
+         return U64( usage.ru_maxrss ) * 1024; // kilobytes
+      #endif
+   #endif
+      return 0;
+   }
+
+   // current resident set size of the process in bytes (0 if unknown; only Linux reports it)
+   inline U64 current_rss_bytes() {
+   #ifdef __linux__
+      U64 total_pages = 0, resident_pages = 0;
+      if ( std::FILE *statm = std::fopen("/proc/self/statm", "r") ) {
+         Bool const is_read = std::fscanf( statm, "%llu %llu", (unsigned long long*) &total_pages, (unsigned long long*) &resident_pages ) == 2;
+         std::fclose( statm );
+         if ( is_read )
+            return resident_pages * U64( sysconf(_SC_PAGESIZE) );
+      }
+   #endif
+      return 0;
+   }
+
+   // the name of the calling thread's innermost stage (nullptr outside of stages)
+   inline char const * current_stage() {
+      return detail::open_stage;
+   }
+
+   class ScopedStage {
+   public:
+      // is_pool_work: opened by a pool worker for a job started in the stage `name`
+      explicit ScopedStage( char const *name, Bool is_pool_work=false ):
+         m_name         ( name ),
+         m_outer_name   ( detail::open_stage ),
+         m_start        ( detail::this_thread ),
+         m_is_pool_work ( is_pool_work )
+      {
+         detail::this_thread.stage_peak = m_start.net_bytes;
+         detail::open_stage = name;
+      }
+
+      ~ScopedStage() {
+         auto &counters = detail::this_thread;
+         detail::ThreadCounters const end = counters;
+         counters.stage_peak = std::max( end.stage_peak, m_start.stage_peak ); // hand the peak back to the enclosing stage
+         detail::open_stage  = m_outer_name;
+         std::lock_guard lock( detail::stages_mutex() );
+         auto &stages = detail::stages();
+         auto  it     = std::find_if( stages.begin(), stages.end(), [this]( auto const &s ) { return std::strcmp(s.name, m_name) == 0; } );
+         if ( it == stages.end() ) {
+            stages.push_back({ m_name });
+            it = stages.end() - 1;
+         }
+         U64 const allocations = end.allocations - m_start.allocations,
+                   bytes       = end.bytes - m_start.bytes,
+                   peak_growth = U64( end.stage_peak - m_start.net_bytes );
+         if ( m_is_pool_work ) {
+            it->pool_allocations += allocations;
+            it->pool_bytes       += bytes;
+            it->pool_peak_growth  = std::max( it->pool_peak_growth, peak_growth );
+            return;
+         }
+         it->calls       += 1;
+         it->allocations += allocations;
+         it->bytes       += bytes;
+         it->peak_growth  = std::max( it->peak_growth, peak_growth );
+      }
+
+      ScopedStage( ScopedStage const & )             = delete;
+      ScopedStage & operator=( ScopedStage const & ) = delete;
+
+   private:
+      char const              *m_name,
+                              *m_outer_name;
+      detail::ThreadCounters   m_start; // including the enclosing stage's peak
+      Bool                     m_is_pool_work;
+   };
+
+   inline void print_report( std::FILE *out = stderr ) {
+      if constexpr ( not is_enabled )
+         return;
+      Vec<StageStats> stages;
+      {
+         std::lock_guard lock( detail::stages_mutex() );
+         stages = detail::stages();
+      }
+      std::fprintf( out, "%-36s %8s %12s %14s %14s\n", "stage", "calls", "allocations", "allocated MiB", "peak +MiB" );
+      for ( auto const &stage : stages ) {
+         std::fprintf( out, "%-36s %8llu %12llu %14.2f %14.2f\n", stage.name, (unsigned long long) stage.calls,
+                       (unsigned long long) stage.allocations, stage.bytes / 1048576.0, stage.peak_growth / 1048576.0 );
+         if ( stage.pool_allocations > 0 or stage.pool_peak_growth > 0 )
+            std::fprintf( out, "%-36s %8s %12llu %14.2f %14.2f\n", "  (pool workers)", "",
+                          (unsigned long long) stage.pool_allocations, stage.pool_bytes / 1048576.0, stage.pool_peak_growth / 1048576.0 );
+      }
+      Counters const total = counters();
+      std::fprintf( out, "total: %llu allocations (%.2f MiB), %llu still live (%.2f MiB); heap peak %.2f MiB, peak RSS %.2f MiB\n",
+                    (unsigned long long) total.allocations, total.bytes / 1048576.0,
+                    (unsigned long long) (total.allocations - total.deallocations), live_bytes() / 1048576.0,
+                    peak_bytes() / 1048576.0, peak_rss_bytes() / 1048576.0 );
+   }
+}
+
+#if defined(DV1478_TRACK_ALLOCATIONS) and defined(DV1478_ALLOCATION_TRACKER_IMPLEMENTATION)
+// Every block is preceded by a header holding its size and the header's own size (the offset
+// of the block), padded to the block's alignment.
+namespace AllocationTracker::detail {
+   inline void * tracked_allocate( Size size, Size alignment ) {
+      alignment          = std::max( alignment, alignof(std::max_align_t) );
+      Size const offset  = (2 * sizeof(Size) + alignment - 1) / alignment * alignment;
+      Size const total   = (offset + size + alignment - 1) / alignment * alignment;
+      Byte *block        = static_cast<Byte*>( std::aligned_alloc(alignment, total) );
+      if ( not block )
+         return nullptr;
+      Byte *user = block + offset;
+      reinterpret_cast<Size*>( user )[-1] = size;
+      reinterpret_cast<Size*>( user )[-2] = offset;
+      on_allocate( size );
+      return user;
+   }
+
+   inline void tracked_free( void *pointer ) {
+      if ( not pointer )
+         return;
+      Byte *user = static_cast<Byte*>( pointer );
+      on_deallocate( reinterpret_cast<Size*>(user)[-1] );
+      std::free( user - reinterpret_cast<Size*>(user)[-2] );
+   }
+
+   inline void * tracked_new( Size size, Size alignment ) {
+      for (;;) {
+         if ( void *pointer = tracked_allocate(size, alignment) )
+            return pointer;
+         if ( auto handler = std::get_new_handler() )
+            handler();
+         else
+            throw std::bad_alloc();
+      }
+   }
+}
+
+void * operator new  ( Size size )                                          { return AllocationTracker::detail::tracked_new( size, alignof(std::max_align_t) ); }
+void * operator new[]( Size size )                                          { return AllocationTracker::detail::tracked_new( size, alignof(std::max_align_t) ); }
+void * operator new  ( Size size, std::align_val_t alignment )              { return AllocationTracker::detail::tracked_new( size, Size(alignment) ); }
+void * operator new[]( Size size, std::align_val_t alignment )              { return AllocationTracker::detail::tracked_new( size, Size(alignment) ); }
+void * operator new  ( Size size, std::nothrow_t const & ) noexcept         { return AllocationTracker::detail::tracked_allocate( size, alignof(std::max_align_t) ); }
+void * operator new[]( Size size, std::nothrow_t const & ) noexcept         { return AllocationTracker::detail::tracked_allocate( size, alignof(std::max_align_t) ); }
+void   operator delete  ( void *pointer ) noexcept                          { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete[]( void *pointer ) noexcept                          { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete  ( void *pointer, Size ) noexcept                    { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete[]( void *pointer, Size ) noexcept                    { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete  ( void *pointer, std::align_val_t ) noexcept        { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete[]( void *pointer, std::align_val_t ) noexcept        { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete  ( void *pointer, Size, std::align_val_t ) noexcept  { AllocationTracker::detail::tracked_free( pointer ); }
+void   operator delete[]( void *pointer, Size, std::align_val_t ) noexcept  { AllocationTracker::detail::tracked_free( pointer ); }
+#endif
+
+// EOF
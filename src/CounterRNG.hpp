@@ -0,0 +1,199 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/RNG.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <span>
+
+// SplitMix64 output function; a cheap, well-mixed hash of a 64-bit value.
+constexpr U64 mix64( U64 x ) {
+   x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+   return x ^ (x >> 31);
+}
+
+namespace RNG {
+   // Counter-based Philox4x32-10 generator (Salmon et al., "Parallel random numbers: as easy as
+   // 1, 2, 3"). The n-th output is a pure function of (seed, stream, n), so streams can be split
+   // off for every region, tile or thread and skipped ahead in O(1); results never depend on the
+   // order or the thread in which the streams are consumed. Satisfies UniformRandomBitGenerator.
+   class CounterEngine {
+   public:
+      using result_type = U64;
+
+      explicit CounterEngine( U64 seed=0, U64 stream=0 ):
+         m_seed   ( seed   ),
+         m_stream ( stream )
+      {}
+
+      // seeded from another engine (e.g. to derive a counter-based family from an RNG::Engine)
+      static CounterEngine from( Engine &rng_engine ) {
+         return CounterEngine( Int<U64>{ rng_engine, 0, std::numeric_limits<U64>::max() }() );
+      }
+
+      static constexpr result_type min() {
+         return 0;
+      }
+
+      static constexpr result_type max() {
+         return std::numeric_limits<U64>::max();
+      }
+
+      // an independent stream; the same stream_id always yields the same stream
+      CounterEngine split( U64 stream_id ) const {
+         return CounterEngine( m_seed, mix64(m_stream + mix64(stream_id + 1)) );
+      }
+
+      U64 operator()() {
+         U64 const block_index = m_position >> 1;
+         if ( block_index != m_cached_block_index ) {
+            m_cached_block       = generate_block( block_index );
+            m_cached_block_index = block_index;
+         }
+         return m_cached_block[ m_position++ & 1 ];
+      }
+
+      F64 unit() { // [0,1)
+         return ((*this)() >> 11) * 0x1.0p-53;
+      }
+
+      // the position-th output of the stream (without advancing)
+      U64 at( U64 position ) const {
+         auto const block = generate_block( position >> 1 );
+         return position & 1?  block[1]  :  block[0];
+      }
+
+      void discard( U64 count ) {
+         m_position += count;
+      }
+
+      U64 position() const {
+         return m_position;
+      }
+
+      // the next out.size() outputs, as that many calls of operator() would return them
+      void fill( std::span<U64> out ) {
+         Size i = 0;
+         for ( ;  i < out.size() and (m_position & 1);  ++i ) // align to a block
+            out[i] = (*this)();
+         for ( ;  i + 2*batch_blocks <= out.size();  i += 2*batch_blocks ) {
+            generate_blocks( m_position >> 1, out.data() + i );
+            m_position += 2*batch_blocks;
+         }
+         for ( ;  i < out.size();  ++i )
+            out[i] = (*this)();
+      }
+
+      // 32-bit outputs; each U64 output provides two (low half first). After an odd count, the
+      // unused high half is handed out first by the next fill of U32s, so splitting a fill into
+      // several calls gives the same values; any other use of the engine in between discards it.
+      void fill( std::span<U32> out ) {
+         Size start = 0;
+         if ( m_spare_position == m_position and not out.empty() ) {
+            out[start++]     = m_spare_half;
+            m_spare_position = std::numeric_limits<U64>::max();
+         }
+         Arr<U64, 2*batch_blocks> buffer;
+         for ( Size i = start;  i < out.size();  i += 2 * buffer.size() ) {
+            Size const count = std::min( out.size() - i, 2 * buffer.size() );
+            fill( std::span<U64>(buffer.data(), (count + 1) / 2) );
+            for ( Size j = 0;  j < count;  ++j )
+               out[i+j] = U32( buffer[j/2] >> (32 * (j & 1)) );
+            if ( count & 1 ) {
+               m_spare_half     = U32( buffer[count/2] >> 32 );
+               m_spare_position = m_position;
+            }
+         }
+      }
+
+      // the 128-bit Philox output for a counter block, as two U64
+      Arr<U64,2> generate_block( U64 block_index ) const {
+         U32 c[4] = { U32(block_index), U32(block_index >> 32), U32(m_stream), U32(m_stream >> 32) },
+             k[2] = { U32(m_seed), U32(m_seed >> 32) };
+         for ( Idx round = 0;  round < 10;  ++round ) {
+            U64 const p0 = U64(0xD251'1F53u) * c[0],
+                      p1 = U64(0xCD9E'8D57u) * c[2];
+            U32 const next[4] = { U32(p1 >> 32) ^ c[1] ^ k[0],  U32(p1),
+                                  U32(p0 >> 32) ^ c[3] ^ k[1],  U32(p0) };
+            std::copy( next, next + 4, c );
+            k[0] += 0x9E37'79B9u;
+            k[1] += 0xBB67'AE85u;
+         }
+         return { U64(c[0]) | (U64(c[1]) << 32),  U64(c[2]) | (U64(c[3]) << 32) };
+      }
+
+   private:
+      static constexpr Size batch_blocks = 16;
+
+      // batch_blocks consecutive blocks at once; the lanes are independent, so the rounds vectorize
+      void generate_blocks( U64 first_block_index, U64 *out ) const {
+         U32 c0[batch_blocks], c1[batch_blocks], c2[batch_blocks], c3[batch_blocks];
+         for ( Idx lane = 0;  lane < batch_blocks;  ++lane ) {
+            c0[lane] = U32( first_block_index + lane );
+            c1[lane] = U32( (first_block_index + lane) >> 32 );
+            c2[lane] = U32( m_stream );
+            c3[lane] = U32( m_stream >> 32 );
+         }
+         U32 k0 = U32( m_seed ),
+             k1 = U32( m_seed >> 32 );
+         for ( Idx round = 0;  round < 10;  ++round ) {
+            for ( Idx lane = 0;  lane < batch_blocks;  ++lane ) {
+               U64 const p0 = U64(0xD251'1F53u) * c0[lane],
+                         p1 = U64(0xCD9E'8D57u) * c2[lane];
+               c0[lane] = U32(p1 >> 32) ^ c1[lane] ^ k0;
+               c2[lane] = U32(p0 >> 32) ^ c3[lane] ^ k1;
+               c1[lane] = U32(p1);
+               c3[lane] = U32(p0);
+            }
+            k0 += 0x9E37'79B9u;
+            k1 += 0xBB67'AE85u;
+         }
+         for ( Idx lane = 0;  lane < batch_blocks;  ++lane ) {
+            out[2*lane]     = U64(c0[lane]) | (U64(c1[lane]) << 32);
+            out[2*lane + 1] = U64(c2[lane]) | (U64(c3[lane]) << 32);
+         }
+      }
+
+      U64         m_seed,
+                  m_stream,
+                  m_position           = 0,
+                  m_cached_block_index = std::numeric_limits<U64>::max(),
+                  m_spare_position     = std::numeric_limits<U64>::max(); // m_position when m_spare_half was kept
+      Arr<U64,2>  m_cached_block       = {};
+      U32         m_spare_half         = 0;
+   };
+
+   // Bulk counterparts of Real and Int for a CounterEngine: whole arrays are drawn from batched
+   // blocks and converted in straight loops, instead of one distribution call per value.
+   // Both consume one 32-bit half of an output per value.
+
+   // uniform in [min,max); min + u*(max-min) can round up to max, hence the clamp
+   inline void fill_real( CounterEngine &engine, std::span<F32> out, F32 min, F32 max ) {
+      F32 const     below_max = min < max?  std::nextafter(max, min)  :  max;
+      Arr<U32,256>  bits;
+      for ( Size i = 0;  i < out.size();  i += bits.size() ) {
+         Size const count = std::min( out.size() - i, bits.size() );
+         engine.fill( std::span<U32>(bits.data(), count) );
+         for ( Size j = 0;  j < count;  ++j )
+            out[i+j] = std::min( min + (bits[j] >> 8) * 0x1.0p-24f * (max - min), below_max );
+      }
+   }
+
+   // uniform in [min,max], by multiply-shift (Lemire) without rejection; the bias is at most
+   // (max-min+1) / 2^32, which is negligible for the small ranges this is meant for
+   inline void fill_int( CounterEngine &engine, std::span<U32> out, U32 min, U32 max ) {
+      assert( min <= max );
+      U64 const range = U64(max) - min + 1;
+      engine.fill( out );
+      if ( range > std::numeric_limits<U32>::max() )
+         return;
+      for ( auto &value : out )
+         value = min + U32( (value * range) >> 32 );
+   }
+}
+
+// EOF
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/AllocationTracker.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <mutex>
+
+// Shared state between a generation thread and a UI that watches it. The generator reports
+// stages (begin_stage/end_stage) and publishes previews; the UI takes snapshots and previews with
+// try_ methods, which never wait for the generator: at worst they return nothing and the UI keeps
+// showing what it already has. Locks are only held to copy a few words or to swap buffers.
+class GenerationMonitor {
+public:
+   struct Stage {
+      char const  *name;
+      F64          seconds  = 0; // so far, while running
+      F32          progress = 0; // within the stage, if it reports any
+      U64          pixels   = 0; // work done, for throughput
+      U64          cells    = 0;
+      Bool         is_done  = false;
+   };
+
+   struct Snapshot {
+      Vec<Stage>   stages;
+      Size         stage_count = 0; // expected in total
+      F64          seconds     = 0;
+      Bool         is_running  = false,
+                   is_ok       = false;
+      U64          heap_bytes  = 0; // live C++ heap (only with DV1478_TRACK_ALLOCATIONS)
+      U64          rss_bytes   = 0,
+                   peak_rss_bytes = 0;
+
+      F32 progress() const {
+         F32 done = 0;
+         for ( auto const &stage : stages )
+            done += stage.is_done? 1.0f : stage.progress;
+         return stage_count? done / stage_count : .0f;
+      }
+   };
+
+   // RGBA preview of at most max_preview_side pixels per side
+   struct Preview {
+      Vec<RGBA>    pixels;
+      V2u          dimensions { 0, 0 };
+      U64          version = 0;
+   };
+
+   static constexpr Size max_preview_side = 512;
+
+   // called before the generation thread is started, so that is_running() holds right away
+   void start( Size stage_count ) {
+      std::lock_guard lock( m_mutex );
+      m_stages.clear();
+      m_stage_count       = stage_count;
+      m_start             = Clock::now();
+      m_is_ok             = false;
+      m_is_running        = true;
+      m_is_stop_requested = false;
+   }
+
+   void begin_stage( char const *name ) {
+      std::lock_guard lock( m_mutex );
+      m_stages.push_back({ name });
+      m_stage_start = Clock::now();
+   }
+
+   // fraction of the current stage that is done
+   void set_stage_progress( F32 progress ) {
+      std::lock_guard lock( m_mutex );
+      assert( not m_stages.empty() );
+      m_stages.back().progress = progress;
+   }
+
+   void end_stage( U64 pixels=0, U64 cells=0 ) {
+      std::lock_guard lock( m_mutex );
+      assert( not m_stages.empty() );
+      auto &stage    = m_stages.back();
+      stage.seconds  = std::chrono::duration<F64>( Clock::now() - m_stage_start ).count();
+      stage.progress = 1.0f;
+      stage.pixels   = pixels;
+      stage.cells    = cells;
+      stage.is_done  = true;
+   }
+
+   void finish( Bool is_ok ) {
+      std::lock_guard lock( m_mutex );
+      m_end        = Clock::now();
+      m_is_ok      = is_ok;
+      m_is_running = false;
+   }
+
+   // cooperative cancellation: the generator polls is_stop_requested() between stages
+   void request_stop() {
+      m_is_stop_requested = true;
+   }
+
+   Bool is_stop_requested() const {
+      return m_is_stop_requested;
+   }
+
+   Bool is_running() const {
+      return m_is_running;
+   }
+
+   // colours every cell (or region) of the map; downsampled by nearest neighbour to max_preview_side
+   template <typename T_Map>
+   void publish_preview( T_Map const &map ) {
+      Size const  scale  = std::max<Size>( 1, (std::max(map.width(), map.height()) + max_preview_side - 1) / max_preview_side );
+      V2u const   dimensions ( (map.width() + scale - 1) / scale, (map.height() + scale - 1) / scale );
+      m_back.pixels.resize( Size(dimensions.x) * dimensions.y );
+      m_back.dimensions = dimensions;
+      for ( Size y = 0;  y < dimensions.y;  ++y )
+         for ( Size x = 0;  x < dimensions.x;  ++x )
+            m_back.pixels[ y * dimensions.x + x ] = index_colour( map(x * scale, y * scale) );
+      std::lock_guard lock( m_preview_mutex );
+      m_back.version = ++m_preview_version;
+      std::swap( m_back, m_ready );
+   }
+
+   // the newest snapshot, unless the generator holds the lock at this moment
+   Opt<Snapshot> try_snapshot() const {
+      std::unique_lock lock( m_mutex, std::try_to_lock );
+      if ( not lock )
+         return {};
+      Snapshot snapshot;
+      snapshot.stages      = m_stages;
+      snapshot.stage_count = m_stage_count;
+      snapshot.is_running  = m_is_running;
+      snapshot.is_ok       = m_is_ok;
+      auto const now       = Clock::now();
+      snapshot.seconds     = std::chrono::duration<F64>( (m_is_running? now : m_end) - m_start ).count();
+      if ( m_is_running and not m_stages.empty() and not m_stages.back().is_done )
+         snapshot.stages.back().seconds = std::chrono::duration<F64>( now - m_stage_start ).count();
+      lock.unlock();
+      snapshot.heap_bytes     = AllocationTracker::is_enabled? AllocationTracker::live_bytes() : 0;
+      snapshot.rss_bytes      = AllocationTracker::current_rss_bytes();
+      snapshot.peak_rss_bytes = AllocationTracker::peak_rss_bytes();
+      return snapshot;
+   }
+
+   // swaps the newest preview into `preview` if it is newer than what it holds (and the lock is free)
+   Bool try_take_preview( Preview &preview ) {
+      std::unique_lock lock( m_preview_mutex, std::try_to_lock );
+      if ( not lock or m_ready.version <= preview.version )
+         return false;
+      std::swap( m_ready, preview );
+      return true;
+   }
+
+private:
+   using Clock = std::chrono::steady_clock;
+
+   mutable std::mutex   m_mutex;
+   Vec<Stage>           m_stages;
+   Size                 m_stage_count = 0;
+   Clock::time_point    m_start, m_end, m_stage_start;
+   Bool                 m_is_ok       = false;
+   std::atomic<Bool>    m_is_running        = false,
+                        m_is_stop_requested = false;
+
+   // triple buffering: the generator fills m_back, then swaps it with m_ready; the UI swaps
+   // m_ready with its own copy. Nobody ever waits for a conversion or an upload.
+   std::mutex           m_preview_mutex;
+   Preview              m_back,
+                        m_ready;
+   U64                  m_preview_version = 0;
+};
+
+// EOF
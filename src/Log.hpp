@@ -0,0 +1,664 @@
+#pragma once
+
+#include "falk/defs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#if defined(__unix__) or defined(__APPLE__)
+   #include <unistd.h>
+   #define FALK_LOG_HAS_ISATTY 1
+#endif
+
+// Asynchronous logger. A call like ur::log::debug("centre %u at (%.1f,%.1f)", i, x, y) only copies
+// its arguments into a fixed-size record in the calling thread's lock-free ring buffer; a background
+// thread formats the records (printf-style) and writes them to the sink. Messages below min_level
+// are discarded at compile time (DV1478_LOG_LEVEL overrides the default of debug in debug builds and
+// info otherwise). Theme styling (ANSI escapes) is only applied when the sink is a terminal.
+// Arguments may be arithmetic, pointers, char const* or Str (strings are copied, and truncated if
+// a record runs out of room). The format string must be a literal, as only its address is kept, and
+// its conversions are checked against the arguments at compile time.
+namespace ur::log {
+   enum class Level : U8 { debug, info, warning, error, critical };
+
+#ifdef DV1478_LOG_LEVEL
+   Level constexpr min_level = static_cast<Level>( DV1478_LOG_LEVEL );
+#else
+   Level constexpr min_level = isDebugging? Level::debug : Level::info;
+#endif
+
+   // 256-colour foreground (the terminal's default if unset)
+   struct FG {
+      Opt<U8> code;
+      FG() noexcept = default;
+      explicit FG( U8 code ) noexcept:
+         code ( code )
+      {}
+   };
+
+   // 256-colour background (the terminal's default if unset)
+   struct BG {
+      Opt<U8> code;
+      BG() noexcept = default;
+      explicit BG( U8 code ) noexcept:
+         code ( code )
+      {}
+   };
+
+   // ANSI text modifiers; combine with |
+   struct Mod {
+      U8 bits = 0;
+
+      constexpr Mod operator|( Mod other ) const noexcept {
+         return { U8(bits | other.bits) };
+      }
+
+      static Mod const none, bold, faint, italic, underline, slow_blink, fast_blink;
+   };
+   inline Mod constexpr Mod::none       {  0 };
+   inline Mod constexpr Mod::bold       {  1 };
+   inline Mod constexpr Mod::faint      {  2 };
+   inline Mod constexpr Mod::italic     {  4 };
+   inline Mod constexpr Mod::underline  {  8 };
+   inline Mod constexpr Mod::slow_blink { 16 };
+   inline Mod constexpr Mod::fast_blink { 32 };
+
+   inline Str ansi( std::string_view text, FG fg, BG bg, Mod mod ) {
+      Str codes;
+      for ( U8 bit = 0;  bit < 6;  ++bit )
+         if ( mod.bits & (1 << bit) )
+            codes += std::to_string( bit + 1 ) + ";";
+      if ( fg.code )
+         codes += "38;5;" + std::to_string( fg.code.value() ) + ";";
+      if ( bg.code )
+         codes += "48;5;" + std::to_string( bg.code.value() ) + ";";
+      if ( codes.empty() )
+         return Str( text );
+      codes.pop_back();
+      return "\033[" + codes + "m" + Str( text ) + "\033[0m";
+   }
+
+   struct Style {
+      FG  fg  {};
+      BG  bg  {};
+      Mod mod {};
+
+      Str operator()( std::string_view text ) const {
+         return ansi( text, fg, bg, mod );
+      }
+   };
+
+   struct Theme {
+      Style critical,
+            error,
+            warning,
+            plain,
+            header1,
+            header2,
+            header3,
+            debug,
+            selected,
+            list_positive,
+            list_neutral,
+            list_negative;
+   };
+
+   // 256-colour codes
+   namespace CC {
+      U8 constexpr blue_light   =  81;
+      U8 constexpr blue         =  33;
+      U8 constexpr blue_dark    =  26;
+      U8 constexpr red_light    = 196;
+      U8 constexpr red          = 124;
+      U8 constexpr red_dark     =  88;
+      U8 constexpr green_light  =  83;
+      U8 constexpr green        =  35;
+      U8 constexpr green_dark   =  29;
+      U8 constexpr yellow_light = 229;
+      U8 constexpr yellow       = 227;
+      U8 constexpr yellow_dark  = 178;
+      U8 constexpr purple_light = 177;
+      U8 constexpr purple       = 127;
+      U8 constexpr purple_dark  =  53;
+      U8 constexpr orange_light = 222;
+      U8 constexpr orange       = 215;
+      U8 constexpr orange_dark  = 202;
+      U8 constexpr pink_light   = 224;
+      U8 constexpr pink         = 212;
+      U8 constexpr pink_dark    = 200;
+      U8 constexpr cyan_light   = 159;
+      U8 constexpr cyan         =  87;
+      U8 constexpr cyan_dark    =  44;
+      U8 constexpr grey_light   = 250;
+      U8 constexpr grey         = 245;
+      U8 constexpr grey_dark    = 240;
+      U8 constexpr brown_light  = 137;
+      U8 constexpr brown        = 130;
+      U8 constexpr brown_dark   =  94;
+      U8 constexpr white        = 255;
+      U8 constexpr black        =   0;
+   }
+
+   inline Theme const theme {
+      /* .critical      */ { FG{ CC::white       },  BG{ CC::red   },  Mod::bold | Mod::underline },
+      /* .error         */ { FG{ CC::red_light   },  BG{           },  Mod::bold                  },
+      /* .warning       */ { FG{ CC::yellow      },  BG{           },  Mod::bold                  },
+      /* .plain         */ { FG{ CC::grey_dark   },  BG{           },  Mod::none                  },
+      /* .header1       */ { FG{ CC::white       },  BG{           },  Mod::bold | Mod::underline },
+      /* .header2       */ { FG{ CC::grey_light  },  BG{           },  Mod::bold                  },
+      /* .header3       */ { FG{ CC::grey        },  BG{           },  Mod::bold                  },
+      /* .debug         */ { FG{ CC::blue_light  },  BG{           },  Mod::none                  },
+      /* .selected      */ { FG{ CC::green_light },  BG{ CC::black },  Mod::bold                  },
+      /* .list_positive */ { FG{ CC::green_light },  BG{           },  Mod::bold                  },
+      /* .list_neutral  */ { FG{ CC::grey        },  BG{           },  Mod::bold                  },
+      /* .list_negative */ { FG{ CC::red_dark    },  BG{           },  Mod::bold                  },
+   };
+
+   inline Style const & style_of( Level level ) {
+      switch ( level ) {
+         case Level::debug:    return theme.debug;
+         case Level::info:     return theme.plain;
+         case Level::warning:  return theme.warning;
+         case Level::error:    return theme.error;
+         case Level::critical: return theme.critical;
+      }
+      return theme.plain;
+   }
+
+   inline char const * name_of( Level level ) {
+      switch ( level ) {
+         case Level::debug:    return "debug";
+         case Level::info:     return "info";
+         case Level::warning:  return "warning";
+         case Level::error:    return "error";
+         case Level::critical: return "critical";
+      }
+      return "?";
+   }
+
+   namespace detail {
+      struct Record;
+      using Formatter = void (*)( Record const &, Str & );
+
+      // one message; the arguments are packed into the payload by encode() and read back by decode()
+      struct alignas(64) Record {
+         static constexpr Size payload_size = 224;
+         U64          time_ns;
+         char const  *format;
+         Formatter    formatter;
+         Level        level;
+         Byte         payload[ payload_size ];
+      };
+      static_assert( sizeof(Record) == 256 );
+
+      template <typename T>
+      Bool constexpr is_string_v = std::is_same_v<T,Str> or std::is_same_v<T,std::string_view>
+                                or std::is_same_v<T,char const*> or std::is_same_v<T,char*>;
+
+      // the type an argument is handed to snprintf as (strings as C strings, after the default promotions)
+      template <typename T>
+      auto constexpr decoded_type() {
+         if constexpr ( is_string_v<T> )                 return std::type_identity<char const*>{};
+         else if constexpr ( std::is_floating_point_v<T> ) return std::type_identity<F64>{};
+         else if constexpr ( std::is_same_v<T,Bool> )      return std::type_identity<I32>{};
+         else if constexpr ( std::is_enum_v<T> )           return std::type_identity<std::underlying_type_t<T>>{};
+         else                                              return std::type_identity<T>{};
+      }
+      template <typename T>
+      using Decoded = typename decltype( decoded_type<T>() )::type;
+
+      // what a printf conversion needs to know of an argument: its kind (i = integer, f = floating
+      // point, s = string, p = other pointer) and, for integers, its size after the default promotions
+      struct FormatArg {
+         char  kind;
+         Size  size;
+      };
+
+      template <typename T>
+      FormatArg constexpr format_arg_v =
+         is_string_v<T>?                   FormatArg{ 's', 0 }
+       : std::is_floating_point_v<T>?      FormatArg{ 'f', 0 }
+       : std::is_pointer_v<T>?             FormatArg{ 'p', 0 }
+       : std::is_integral_v<Decoded<T>>?   FormatArg{ 'i', std::max(sizeof(Decoded<T>), sizeof(int)) }
+       :                                   FormatArg{ '?', 0 };
+
+      // Whether every conversion in format matches the next argument and the counts agree. Covers
+      // what the logger passes on: flags, width, precision and the length modifiers of C99
+      // (but not '*', %n or wide strings, which are rejected).
+      consteval Bool is_valid_format( char const *format, FormatArg const *args, Size arg_count ) {
+         auto const is_digit = []( char c ) { return c >= '0' and c <= '9'; };
+         Size arg = 0;
+         for ( char const *c = format;  *c;  ++c ) {
+            if ( *c != '%' or *++c == '%' )
+               continue;
+            while ( *c == '-' or *c == '+' or *c == ' ' or *c == '#' or *c == '0' or *c == '\'' )
+               ++c;
+            while ( is_digit(*c) )
+               ++c;
+            if ( *c == '.' )
+               for ( ++c;  is_digit(*c);  ++c );
+            char length = 0;
+            Size size   = sizeof(int);
+            switch ( *c ) {
+               case 'h': length = *c++; if ( *c == 'h' ) ++c;                          break;
+               case 'l': length = *c++; size = sizeof(long);
+                         if ( *c == 'l' ) { length = 'q'; ++c; size = sizeof(long long); } break;
+               case 'j': length = *c++; size = sizeof(std::intmax_t);                   break;
+               case 'z': length = *c++; size = sizeof(Size);                            break;
+               case 't': length = *c++; size = sizeof(std::ptrdiff_t);                  break;
+               case 'L': length = *c++;                                                 break;
+            }
+            if ( arg == arg_count )
+               return false;
+            FormatArg const given = args[arg++];
+            switch ( *c ) {
+               case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+                  if ( given.kind != 'i' or given.size != size or length == 'L' )
+                     return false;
+                  break;
+               case 'c':
+                  if ( given.kind != 'i' or given.size != sizeof(int) or length != 0 )
+                     return false;
+                  break;
+               case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                  if ( given.kind != 'f' or (length != 0 and length != 'l') ) // long doubles are logged as F64
+                     return false;
+                  break;
+               case 's':
+                  if ( given.kind != 's' or length != 0 )
+                     return false;
+                  break;
+               case 'p':
+                  if ( (given.kind != 'p' and given.kind != 's') or length != 0 )
+                     return false;
+                  break;
+               default:
+                  return false;
+            }
+            if ( not *c )
+               return false;
+         }
+         return arg == arg_count;
+      }
+
+      void format_does_not_match_arguments(); // never defined; called to fail a BasicFormat at compile time
+
+      template <typename... T_Args>
+      struct BasicFormat {
+         char const *text;
+
+         // consteval: a format that is not a compile-time constant (such as a literal) is an error too
+         consteval BasicFormat( char const *format ):
+            text ( format )
+         {
+            FormatArg constexpr args[] { format_arg_v<T_Args>..., FormatArg{} }; // never empty
+            if ( not is_valid_format(format, args, sizeof...(T_Args)) )
+               format_does_not_match_arguments();
+         }
+      };
+
+      // payload bytes an argument needs besides the text of strings (length and terminator)
+      template <typename T>
+      Size constexpr fixed_size_v = is_string_v<T>? sizeof(U16) + 1 : sizeof(Decoded<T>);
+
+      template <typename T>
+      void encode( Byte *&cursor, Size &text_budget, T const &arg ) {
+         if constexpr ( is_string_v<T> ) {
+            std::string_view text;
+            if constexpr ( std::is_pointer_v<T> )
+               text = arg? arg : "(null)";
+            else text = arg;
+            U16 const length = static_cast<U16>( std::min(text.size(), text_budget) );
+            text_budget -= length;
+            std::memcpy( cursor, &length, sizeof length );
+            std::memcpy( cursor + sizeof length, text.data(), length );
+            cursor[ sizeof length + length ] = '\0';
+            cursor += sizeof length + length + 1;
+         }
+         else {
+            static_assert( std::is_arithmetic_v<T> or std::is_enum_v<T> or std::is_pointer_v<T>,
+                           "log arguments must be arithmetic, pointers or strings" );
+            Decoded<T> const value = static_cast<Decoded<T>>( arg );
+            std::memcpy( cursor, &value, sizeof value );
+            cursor += sizeof value;
+         }
+      }
+
+      template <typename T>
+      Decoded<T> decode( Byte const *&cursor ) {
+         if constexpr ( is_string_v<T> ) {
+            U16 length;
+            std::memcpy( &length, cursor, sizeof length );
+            char const *text = reinterpret_cast<char const*>( cursor + sizeof length );
+            cursor += sizeof length + length + 1;
+            return text;
+         }
+         else {
+            Decoded<T> value;
+            std::memcpy( &value, cursor, sizeof value );
+            cursor += sizeof value;
+            return value;
+         }
+      }
+
+      template <typename... T_Args>
+      void format_record( Record const &record, Str &out ) {
+         Byte const *cursor = record.payload;
+         // braced initialisation decodes the arguments in order
+         std::tuple<Decoded<T_Args>...> const args { decode<T_Args>(cursor)... };
+         std::apply( [&]( auto... values ) {
+            #pragma GCC diagnostic push
+            #pragma GCC diagnostic ignored "-Wformat-nonliteral"
+            #pragma GCC diagnostic ignored "-Wformat-security"
+            char       buffer[512];
+            I32 const  length = std::snprintf( buffer, sizeof buffer, record.format, values... );
+            if ( length <= 0 )
+               return;
+            if ( Size(length) < sizeof buffer ) {
+               out.append( buffer, length );
+               return;
+            }
+            Size const start = out.size();
+            out.resize( start + length + 1 );
+            std::snprintf( out.data() + start, length + 1, record.format, values... );
+            out.resize( start + length );
+            #pragma GCC diagnostic pop
+         }, args );
+      }
+
+      // single-producer single-consumer ring of records: the owning thread pushes, the writer pops
+      class RecordRing {
+      public:
+         static constexpr Size capacity = 1 << 11; // 512 KiB per logging thread
+
+         explicit RecordRing( U32 thread_id ):
+            m_thread_id ( thread_id ),
+            m_records   ( std::make_unique<Record[]>(capacity) )
+         {}
+
+         // waits (yielding) while the ring is full; the writer never holds records for long
+         Record & acquire() {
+            U64 const tail = m_tail.load( std::memory_order_relaxed );
+            while ( tail - m_head.load(std::memory_order_acquire) >= capacity )
+               std::this_thread::yield();
+            return m_records[ tail % capacity ];
+         }
+
+         void publish() {
+            m_tail.store( m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release );
+         }
+
+         U64 tail() const { return m_tail.load( std::memory_order_acquire ); }
+         U64 head() const { return m_head.load( std::memory_order_acquire ); }
+
+         Record const & at( U64 position ) const {
+            return m_records[ position % capacity ];
+         }
+
+         void release( U64 new_head ) {
+            m_head.store( new_head, std::memory_order_release );
+         }
+
+         U32 thread_id() const {
+            return m_thread_id;
+         }
+
+         // hands a drained ring to a new thread
+         void reassign( U32 thread_id ) {
+            m_thread_id = thread_id;
+         }
+
+      private:
+         U32                              m_thread_id;
+         UPtr<Record[]>                   m_records;
+         alignas(64) std::atomic<U64>     m_tail = 0; // written by the producer
+         alignas(64) std::atomic<U64>     m_head = 0; // written by the writer
+      };
+
+      // Owns the rings and the writer thread. A thread leases a ring on its first message and hands
+      // it back when it exits; the ring goes to the next new thread once the writer has drained it,
+      // so threads started per job (say, one per click) do not pile up rings.
+      class Backend {
+      public:
+         static Backend & instance() {
+            static Backend backend;
+            return backend;
+         }
+
+         ~Backend() {
+            {
+               std::lock_guard lock( m_mutex );
+               m_is_running = false;
+            }
+            m_wake.notify_all();
+            m_writer.join();
+         }
+
+         RecordRing & local_ring() {
+            thread_local RingLease lease { *this };
+            return lease.ring;
+         }
+
+         U64 now_ns() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - m_epoch ).count();
+         }
+
+         void set_sink( std::FILE *sink, Opt<Bool> is_styled ) {
+            flush();
+            std::lock_guard lock( m_mutex );
+            m_sink      = sink;
+            m_is_styled = is_styled? is_styled.value() : is_terminal( sink );
+         }
+
+         // blocks until everything logged before the call has been written
+         void flush() {
+            Vec<std::pair<RecordRing*,U64>> targets;
+            std::unique_lock lock( m_mutex );
+            for ( auto const &ring : m_rings )
+               targets.emplace_back( ring.get(), ring->tail() );
+            m_is_flush_requested = true;
+            m_wake.notify_all();
+            m_drained.wait( lock, [&] {
+               return std::all_of( targets.begin(), targets.end(), []( auto const &t ) { return t.first->head() >= t.second; } );
+            } );
+         }
+
+      private:
+         using Clock = std::chrono::steady_clock;
+
+         struct RingLease {
+            Backend    &backend;
+            RecordRing &ring;
+
+            explicit RingLease( Backend &backend ):
+               backend ( backend ),
+               ring    ( backend.lease_ring() )
+            {}
+
+            ~RingLease() {
+               backend.return_ring( ring );
+            }
+         };
+
+         std::mutex               m_mutex;
+         std::condition_variable  m_wake,
+                                  m_drained;
+         Vec<UPtr<RecordRing>>    m_rings;
+         Vec<RecordRing*>         m_returned_rings;     // by threads that have exited
+         U32                      m_next_thread_id     = 0;
+         std::FILE               *m_sink               = stdout;
+         Bool                     m_is_styled          = is_terminal( stdout );
+         Bool                     m_is_running         = true;
+         Bool                     m_is_flush_requested = false;
+         Clock::time_point        m_epoch              = Clock::now();
+         std::thread              m_writer { [this] { write_loop(); } }; // last, it uses the members above
+
+         static Bool is_terminal( std::FILE *file ) {
+         #ifdef FALK_LOG_HAS_ISATTY
+            return isatty( fileno(file) ) == 1;
+         #else
+            return false;
+         #endif
+         }
+
+         // "  3.141592 t0   warning  " (seconds since start, thread, level); formatting this with
+         // snprintf("%f") took longer than most messages
+         static void append_prefix( Str &out, U64 time_ns, U32 thread_id, Level level ) {
+            auto const append_number = [&]( U64 value, Size width, char fill ) {
+               char digits[20];
+               Size count = 0;
+               do {
+                  digits[count++] = char( '0' + value % 10 );
+                  value /= 10;
+               } while ( value );
+               out.append( width > count? width - count : 0, fill );
+               while ( count )
+                  out += digits[--count];
+            };
+            U64 const microseconds = time_ns / 1000;
+            append_number( microseconds / 1'000'000, 3, ' ' );
+            out += '.';
+            append_number( microseconds % 1'000'000, 6, '0' );
+            out += " t";
+            Size const start = out.size();
+            append_number( thread_id, 0, ' ' );
+            out.append( 4 - std::min<Size>(3, out.size() - start), ' ' );
+            Str const name = name_of( level );
+            out += name;
+            out.append( 9 - name.size(), ' ' );
+         }
+
+         RecordRing & lease_ring() {
+            std::lock_guard lock( m_mutex );
+            U32 const thread_id = m_next_thread_id++;
+            // a returned ring may still hold its last thread's messages (written under that thread's id)
+            auto const drained = std::find_if( m_returned_rings.begin(), m_returned_rings.end(),
+                                               []( RecordRing const *ring ) { return ring->head() == ring->tail(); } );
+            if ( drained != m_returned_rings.end() ) {
+               RecordRing &ring = **drained;
+               *drained = m_returned_rings.back();
+               m_returned_rings.pop_back();
+               ring.reassign( thread_id );
+               return ring;
+            }
+            m_rings.push_back( std::make_unique<RecordRing>(thread_id) );
+            return *m_rings.back();
+         }
+
+         void return_ring( RecordRing &ring ) {
+            std::lock_guard lock( m_mutex );
+            m_returned_rings.push_back( &ring );
+         }
+
+         void write_loop() {
+            struct Pending { U64 time_ns; RecordRing const *ring; U64 position; };
+            Vec<Pending>                     pending;
+            Vec<std::pair<RecordRing*,U64>>  ends;
+            Str                              text, line;
+            for (;;) {
+               std::unique_lock lock( m_mutex );
+               if ( pending.empty() ) // producers never signal; poll while idle, keep going while busy
+                  m_wake.wait_for( lock, std::chrono::milliseconds(2), [this] { return m_is_flush_requested or not m_is_running; } );
+               m_is_flush_requested = false;
+               Bool const is_final = not m_is_running;
+               // gather everything published so far and interleave the threads by time
+               pending.clear();
+               ends.clear();
+               for ( auto const &ring : m_rings ) {
+                  U64 const head = ring->head(),
+                            tail = ring->tail();
+                  for ( U64 position = head;  position < tail;  ++position )
+                     pending.push_back({ ring->at(position).time_ns, ring.get(), position });
+                  ends.emplace_back( ring.get(), tail );
+               }
+               std::FILE *sink      = m_sink;
+               Bool const is_styled = m_is_styled;
+               lock.unlock(); // producers only need the lock to register
+
+               std::stable_sort( pending.begin(), pending.end(), []( auto const &lhs, auto const &rhs ) { return lhs.time_ns < rhs.time_ns; } );
+               text.clear();
+               for ( auto const &[time_ns, ring, position] : pending ) {
+                  Record const &record = ring->at( position );
+                  Level const   level  = record.level;
+                  Str &out = is_styled? line : text;
+                  line.clear();
+                  append_prefix( out, time_ns, ring->thread_id(), level );
+                  record.formatter( record, out );
+                  if ( is_styled )
+                     text += style_of( level )( line );
+                  text += '\n';
+               }
+               if ( not text.empty() ) {
+                  std::fwrite( text.data(), 1, text.size(), sink );
+                  std::fflush( sink );
+               }
+               for ( auto const &[ring, end] : ends )
+                  ring->release( end );
+               m_drained.notify_all();
+               if ( is_final )
+                  return;
+            }
+         }
+      };
+
+      template <Level T_level, typename... T_Args>
+      void write( char const *format, T_Args const &...args ) {
+         Size constexpr fixed_size = ( Size(0) + ... + fixed_size_v<T_Args> );
+         static_assert( fixed_size <= Record::payload_size, "too many log arguments for one record" );
+         auto    &backend = Backend::instance();
+         auto    &ring    = backend.local_ring();
+         Record  &record  = ring.acquire();
+         record.time_ns   = backend.now_ns();
+         record.format    = format;
+         record.formatter = &format_record<T_Args...>;
+         record.level     = T_level;
+         Byte *cursor      = record.payload;
+         Size  text_budget = Record::payload_size - fixed_size;
+         ( encode<T_Args>( cursor, text_budget, args ), ... );
+         ring.publish();
+      }
+   }
+
+   // the format parameter type: type_identity keeps it out of deduction, so the arguments decide T_Args
+   template <typename... T_Args>
+   using Format = detail::BasicFormat<std::type_identity_t<std::decay_t<T_Args const>>...>;
+
+   template <Level T_level, typename... T_Args>
+   inline void write( Format<T_Args...> format, T_Args const &...args ) {
+      if constexpr ( T_level >= min_level )
+         detail::write<T_level, std::decay_t<T_Args const>...>( format.text, args... );
+   }
+
+   template <typename... T_Args> inline void debug(    Format<T_Args...> format, T_Args const &...args ) { write<Level::debug>(    format, args... ); }
+   template <typename... T_Args> inline void info(     Format<T_Args...> format, T_Args const &...args ) { write<Level::info>(     format, args... ); }
+   template <typename... T_Args> inline void warning(  Format<T_Args...> format, T_Args const &...args ) { write<Level::warning>(  format, args... ); }
+   template <typename... T_Args> inline void error(    Format<T_Args...> format, T_Args const &...args ) { write<Level::error>(    format, args... ); }
+   template <typename... T_Args> inline void critical( Format<T_Args...> format, T_Args const &...args ) { write<Level::critical>( format, args... ); }
+   // the names of the original synchronous ur::log
+   template <typename... T_Args> inline void print(    Format<T_Args...> format, T_Args const &...args ) { write<Level::info>(     format, args... ); }
+   template <typename... T_Args> inline void fatal(    Format<T_Args...> format, T_Args const &...args ) { write<Level::critical>( format, args... ); }
+
+   // blocks until every message logged before the call has been written
+   inline void flush() {
+      detail::Backend::instance().flush();
+   }
+
+   // is_styled defaults to whether the sink is a terminal
+   inline void set_sink( std::FILE *sink, Opt<Bool> is_styled = {} ) {
+      detail::Backend::instance().set_sink( sink, is_styled );
+   }
+}
+
+// EOF
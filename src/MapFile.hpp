@@ -0,0 +1,382 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/Parallel.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <zlib.h>
+
+#if defined(__unix__) or defined(__APPLE__)
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+   #define FALK_MAP_FILE_HAS_MMAP 1
+#endif
+
+// Lossless binary container for label maps ("*.dvmap"). Layout (little-endian):
+//   Header
+//   centres        [centre_count] x Centre        (optional Voronoi centres)
+//   region labels  [region_count] x U64           (optional cell -> region table, see RegionView)
+//   map data       at data_offset (64-byte aligned):
+//                    raw:  width*height indices of index_bytes each, row-major
+//                    zlib: independently compressed tiles (tile_side^2, row-major within a tile)
+//   tile table     [tile_count] x TileEntry       (zlib only)
+// Raw files with index_bytes == sizeof(Idx) can be memory-mapped and used as a MapView without copying.
+namespace MapFile {
+   static_assert( std::endian::native == std::endian::little, "MapFile assumes a little-endian host" );
+
+   U32  constexpr version = 1;
+   char constexpr magic[8] = { 'D','V','1','4','7','8','M','P' };
+
+   enum class Compression : U8 { raw=0, zlib=1 };
+
+   struct Header {
+      char  magic[8];
+      U32   version;
+      U32   header_size;       // sizeof(Header) of the writer
+      U32   width;
+      U32   height;
+      U8    index_bytes;       // 2, 4 or 8
+      U8    compression;       // Compression
+      U16   reserved = 0;
+      U32   tile_side;
+      U64   centre_count;
+      U64   centres_offset;
+      U64   region_count;
+      U64   regions_offset;
+      U64   data_offset;
+      U64   data_size;
+      U64   tile_table_offset;
+   };
+   static_assert( sizeof(Header) == 88 );
+
+   struct Centre {
+      F32  x, y;
+      F32  weight;
+      U32  reserved = 0;
+      U64  index;
+   };
+   static_assert( sizeof(Centre) == 24 );
+
+   struct TileEntry {
+      U64  offset; // from the start of the file
+      U64  size;   // compressed bytes
+   };
+
+   struct SaveOptions {
+      U8           index_bytes       = sizeof(Idx);
+      Compression  compression       = Compression::raw;
+      U32          tile_side         = 256;
+      I32          compression_level = Z_DEFAULT_COMPRESSION;
+      Vec<Centre>  centres;          // optional, see centres_of()
+      Vec<Idx>     region_labels;    // optional, e.g. RegionView::labels()
+   };
+
+   template <Bool T_is_tiled, U8 T_threshold_percentage>
+   Vec<Centre> centres_of( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram ) {
+      Vec<Centre> centres;
+      for ( Idx index = 0;  index < voronoi_diagram.size();  ++index ) {
+         if ( not voronoi_diagram.hasCentre(index) )
+            continue;
+         auto const &centre = voronoi_diagram.getCentre( index );
+         centres.push_back({ centre.pos.x, centre.pos.y, centre.weight, 0, centre.index });
+      }
+      return centres;
+   }
+
+   namespace detail {
+      inline void store_index( Byte *dest, Idx value, U8 index_bytes ) {
+         std::memcpy( dest, &value, index_bytes ); // little-endian: the low bytes come first
+      }
+
+      inline Idx load_index( Byte const *src, U8 index_bytes ) {
+         assert( index_bytes <= sizeof(Idx) );
+         Idx value = 0;
+         std::memcpy( &value, src, index_bytes );
+         return value;
+      }
+
+      inline Size tile_count( Header const &header ) {
+         Size const tiles_x = (Size(header.width)  + header.tile_side - 1) / header.tile_side,
+                    tiles_y = (Size(header.height) + header.tile_side - 1) / header.tile_side;
+         return tiles_x * tiles_y;
+      }
+   }
+
+   // writes the map; returns whether everything succeeded
+   inline Bool save( Str const &path, Map<Idx> const &map, SaveOptions const &options = {},
+                     ThreadPool &thread_pool = ThreadPool::shared() )
+   {
+      U8 const index_bytes = options.index_bytes;
+      assert( index_bytes == 2 or index_bytes == 4 or index_bytes == 8 );
+      assert( options.tile_side > 0 );
+
+      std::FILE *file = std::fopen( path.c_str(), "wb" );
+      if ( not file )
+         return false;
+      Bool is_ok    = true;
+      U64  position = 0; // tracked rather than queried: ftell's long is 32 bits on LLP64
+      auto const write = [&]( void const *data, Size size ) {
+         is_ok = is_ok and ( size == 0 or std::fwrite(data, 1, size, file) == size );
+         position += size;
+      };
+      auto const pad_to = [&]( U64 alignment ) {
+         static Byte constexpr zeros[64] = {};
+         write( zeros, (alignment - position % alignment) % alignment );
+      };
+
+      Header header = {};
+      std::memcpy( header.magic, magic, sizeof magic );
+      header.version      = version;
+      header.header_size  = sizeof(Header);
+      header.width        = static_cast<U32>( map.width()  );
+      header.height       = static_cast<U32>( map.height() );
+      header.index_bytes  = index_bytes;
+      header.compression  = static_cast<U8>( options.compression );
+      header.tile_side    = options.tile_side;
+      write( &header, sizeof header ); // placeholder, rewritten once the offsets are known
+
+      header.centre_count   = options.centres.size();
+      header.centres_offset = position;
+      write( options.centres.data(), options.centres.size() * sizeof(Centre) );
+
+      header.region_count   = options.region_labels.size();
+      header.regions_offset = position;
+      for ( auto label : options.region_labels ) {
+         U64 value = label;
+         write( &value, sizeof value );
+      }
+
+      pad_to( 64 );
+      header.data_offset = position;
+      Size const width = map.width();
+      if ( options.compression == Compression::raw ) {
+         if ( index_bytes == sizeof(Idx) )
+            write( map.data(), map.size() * sizeof(Idx) );
+         else {
+            Vec<Byte> row( width * index_bytes );
+            for ( Size y = 0;  y < map.height();  ++y ) {
+               for ( Size x = 0;  x < width;  ++x )
+                  detail::store_index( &row[x*index_bytes], map(x,y), index_bytes );
+               write( row.data(), row.size() );
+            }
+         }
+      }
+      else { // compress tiles concurrently, in batches to bound memory
+         Size const        tile_side     = options.tile_side,
+                           tiles_x       = (width        + tile_side - 1) / tile_side,
+                           tile_count    = detail::tile_count( header ),
+                           batch_size    = 4 * thread_pool.thread_count();
+         Vec<TileEntry>    tile_table( tile_count );
+         Vec<Vec<Byte>>    compressed( std::min(batch_size, tile_count) );
+         Vec<Bool>         is_tile_ok( compressed.size() );
+         for ( Idx batch_begin = 0;  batch_begin < tile_count;  batch_begin += batch_size ) {
+            Size const batch_count = std::min( batch_size, tile_count - batch_begin );
+            thread_pool.parallel_for( batch_count, [&]( Idx i ) {
+               Idx const   tile    = batch_begin + i;
+               Size const  x_begin = (tile % tiles_x) * tile_side,
+                           y_begin = (tile / tiles_x) * tile_side,
+                           x_end   = std::min( x_begin + tile_side, width        ),
+                           y_end   = std::min( y_begin + tile_side, map.height() );
+               Vec<Byte> raw( (x_end - x_begin) * (y_end - y_begin) * index_bytes );
+               Byte *dest = raw.data();
+               for ( Size y = y_begin;  y < y_end;  ++y )
+                  for ( Size x = x_begin;  x < x_end;  ++x, dest += index_bytes )
+                     detail::store_index( dest, map(x,y), index_bytes );
+               uLongf compressed_size = compressBound( static_cast<uLong>(raw.size()) );
+               compressed[i].resize( compressed_size );
+               is_tile_ok[i] = compress2( compressed[i].data(), &compressed_size, raw.data(),
+                                          static_cast<uLong>(raw.size()), options.compression_level ) == Z_OK;
+               compressed[i].resize( compressed_size );
+            } );
+            for ( Idx i = 0;  i < batch_count;  ++i ) {
+               is_ok = is_ok and is_tile_ok[i];
+               tile_table[batch_begin + i] = { position, compressed[i].size() };
+               write( compressed[i].data(), compressed[i].size() );
+            }
+         }
+         header.tile_table_offset = position;
+         write( tile_table.data(), tile_table.size() * sizeof(TileEntry) );
+      }
+      header.data_size = ( header.tile_table_offset? header.tile_table_offset : position ) - header.data_offset;
+
+      is_ok = is_ok and std::fseek( file, 0, SEEK_SET ) == 0;
+      write( &header, sizeof header );
+      is_ok = ( std::fclose(file) == 0 ) and is_ok;
+      return is_ok;
+   }
+
+   // Opens a map file by memory-mapping it (or reading it whole where mmap is unavailable).
+   class Reader {
+   public:
+      Reader( Str const &path ) {
+      #ifdef FALK_MAP_FILE_HAS_MMAP
+         I32 fd = ::open( path.c_str(), O_RDONLY );
+         struct stat info;
+         if ( fd >= 0 and ::fstat(fd, &info) == 0 and info.st_size > 0
+          and U64(info.st_size) <= std::numeric_limits<Size>::max() ) {
+            void *mapping = ::mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( mapping != MAP_FAILED ) {
+               m_bytes = static_cast<Byte const*>( mapping );
+               m_size  = info.st_size;
+            }
+         }
+         if ( fd >= 0 )
+            ::close( fd );
+      #else
+         std::error_code error;
+         U64 const file_size = std::filesystem::file_size( path, error ); // 64-bit, unlike ftell
+         std::FILE *file = error or file_size > std::numeric_limits<Size>::max()? nullptr : std::fopen( path.c_str(), "rb" );
+         if ( file ) {
+            m_buffer.resize( file_size );
+            if ( std::fread(m_buffer.data(), 1, m_buffer.size(), file) == m_buffer.size() ) {
+               m_bytes = m_buffer.data();
+               m_size  = m_buffer.size();
+            }
+            std::fclose( file );
+         }
+      #endif
+         m_is_ok = validate();
+      }
+
+      ~Reader() {
+      #ifdef FALK_MAP_FILE_HAS_MMAP
+         if ( m_bytes )
+            ::munmap( const_cast<Byte*>(m_bytes), m_size );
+      #endif
+      }
+
+      Reader( Reader const & )             = delete;
+      Reader & operator=( Reader const & ) = delete;
+
+      Bool is_ok() const {
+         return m_is_ok;
+      }
+
+      Header const& header() const {
+         return m_header;
+      }
+
+      V2u dimensions() const {
+         return V2u( m_header.width, m_header.height );
+      }
+
+      Vec<Centre> centres() const {
+         Vec<Centre> centres( m_header.centre_count );
+         if ( not centres.empty() )
+            std::memcpy( centres.data(), m_bytes + m_header.centres_offset, centres.size() * sizeof(Centre) );
+         return centres;
+      }
+
+      // labels are stored as U64; empty if one does not fit into Idx
+      Opt<Vec<Idx>> region_labels() const {
+         Vec<Idx> labels( m_header.region_count );
+         for ( Idx i = 0;  i < labels.size();  ++i ) {
+            U64 value;
+            std::memcpy( &value, m_bytes + m_header.regions_offset + i * sizeof(U64), sizeof value );
+            if ( value > std::numeric_limits<Idx>::max() )
+               return {};
+            labels[i] = static_cast<Idx>( value );
+         }
+         return labels;
+      }
+
+      // zero-copy access; only for raw files whose index width matches Idx
+      Opt<MapView<Idx>> view() const {
+         if ( not m_is_ok
+           or m_header.compression != static_cast<U8>(Compression::raw)
+           or m_header.index_bytes != sizeof(Idx)
+           or reinterpret_cast<std::uintptr_t>(m_bytes + m_header.data_offset) % alignof(Idx) != 0 )
+            return {};
+         return MapView<Idx>( reinterpret_cast<Idx const*>(m_bytes + m_header.data_offset), dimensions() );
+      }
+
+      // decodes the map into memory (tiles are decompressed in parallel); empty on corrupt data
+      Opt<Map<Idx>> load( ThreadPool &thread_pool = ThreadPool::shared() ) const {
+         if ( not m_is_ok )
+            return {};
+         if ( auto maybe_view = view() )
+            return maybe_view->to_map();
+
+         Map<Idx>    map { dimensions() };
+         U8 const    index_bytes = m_header.index_bytes;
+         Byte const *data        = m_bytes + m_header.data_offset;
+         if ( m_header.compression == static_cast<U8>(Compression::raw) ) {
+            thread_pool.parallel_for( map.height(), [&]( Idx y ) {
+               for ( Size x = 0;  x < map.width();  ++x )
+                  map(x,y) = detail::load_index( data + (y * map.width() + x) * index_bytes, index_bytes );
+            }, 16 );
+            return map;
+         }
+
+         Size const        tile_side = m_header.tile_side,
+                           tiles_x   = (m_header.width + tile_side - 1) / tile_side;
+         auto const *const tiles     = reinterpret_cast<TileEntry const*>( m_bytes + m_header.tile_table_offset );
+         std::atomic<Bool> is_ok     = true;
+         thread_pool.parallel_for( detail::tile_count(m_header), [&]( Idx tile ) {
+            TileEntry   entry;
+            std::memcpy( &entry, tiles + tile, sizeof entry );
+            Size const  x_begin = (tile % tiles_x) * tile_side,
+                        y_begin = (tile / tiles_x) * tile_side,
+                        x_end   = std::min<Size>( x_begin + tile_side, map.width()  ),
+                        y_end   = std::min<Size>( y_begin + tile_side, map.height() );
+            Vec<Byte> raw( (x_end - x_begin) * (y_end - y_begin) * index_bytes );
+            uLongf raw_size = static_cast<uLongf>( raw.size() );
+            if ( entry.offset > m_size or entry.size > m_size - entry.offset
+              or uncompress( raw.data(), &raw_size, m_bytes + entry.offset, static_cast<uLong>(entry.size) ) != Z_OK
+              or raw_size != raw.size() ) {
+               is_ok = false;
+               return;
+            }
+            Byte const *src = raw.data();
+            for ( Size y = y_begin;  y < y_end;  ++y )
+               for ( Size x = x_begin;  x < x_end;  ++x, src += index_bytes )
+                  map(x,y) = detail::load_index( src, index_bytes );
+         } );
+         if ( not is_ok )
+            return {};
+         return map;
+      }
+
+   private:
+      Byte const  *m_bytes = nullptr;
+      Size         m_size  = 0;
+      Vec<Byte>    m_buffer; // only used without mmap
+      Header       m_header = {};
+      Bool         m_is_ok  = false;
+
+      // checks the header and that every section lies within the file
+      Bool validate() {
+         if ( not m_bytes or m_size < sizeof(Header) )
+            return false;
+         std::memcpy( &m_header, m_bytes, sizeof(Header) );
+         // count elements of element_size bytes at offset; divides rather than multiplies, so
+         // counts from a corrupt header cannot overflow
+         auto const fits = [this]( U64 offset, U64 count, U64 element_size ) {
+            return offset <= m_size and count <= (m_size - offset) / element_size;
+         };
+         U64 const pixel_count = U64(m_header.width) * m_header.height;
+         Bool const is_raw     = m_header.compression == static_cast<U8>(Compression::raw);
+         return std::memcmp( m_header.magic, magic, sizeof magic ) == 0
+            and m_header.version == version
+            and m_header.header_size == sizeof(Header)
+            and ( m_header.index_bytes == 2 or m_header.index_bytes == 4 or m_header.index_bytes == 8 )
+            and m_header.index_bytes <= sizeof(Idx)
+            and m_header.compression <= static_cast<U8>(Compression::zlib)
+            and m_header.tile_side > 0
+            and fits( m_header.centres_offset, m_header.centre_count, sizeof(Centre) )
+            and fits( m_header.regions_offset, m_header.region_count, sizeof(U64) )
+            and ( not is_raw or fits(m_header.data_offset, pixel_count, m_header.index_bytes) )
+            and ( is_raw     or fits(m_header.tile_table_offset, detail::tile_count(m_header), sizeof(TileEntry)) );
+      }
+   };
+}
+
+// EOF
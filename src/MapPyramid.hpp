@@ -0,0 +1,167 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/Parallel.hpp"
+#include "falk/PngWriter.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "../../stb_image_resize.h"
+
+struct PyramidOptions {
+   U32   tile_side         = 256;
+   I32   compression_level = 1;    // tiles are many and small; favour speed
+   Bool  has_label_tiles   = true; // also write a lossless label pyramid (see label_map2png)
+};
+
+// Exports a map as a Deep Zoom (DZI) tile pyramid that browser viewers such as OpenSeadragon
+// load lazily, so only the visible tiles of huge maps have to be fetched and decoded:
+//   <directory>/<name>.dzi                         descriptor
+//   <directory>/<name>_files/<level>/<x>_<y>.png   colour tiles (RGBA)
+//   <directory>/<name>_labels/<level>/<x>_<y>.png  label tiles (if has_label_tiles)
+// Level max_level is the full resolution and every level below halves it, down to 1x1 at level 0.
+// Labels are downsampled by the mode of each 2x2 block (so they stay valid labels), colours by an
+// sRGB-correct 2:1 box filter (stb_image_resize). Tiles of a level are written concurrently.
+// Peak memory beyond the map itself is about a third of it for the labels and a quarter of the
+// full resolution image for the colours.
+Bool map2deepzoom( Map<Idx> const &map, Str const &directory, Str const &name, PyramidOptions const &options = {},
+                   ThreadPool &thread_pool = ThreadPool::shared() )
+{
+   namespace fs = std::filesystem;
+   assert( options.tile_side > 0 );
+   if ( map.size() == 0 )
+      return false;
+
+   Size max_level = 0;
+   while ( (Size(1) << max_level) < std::max(map.width(), map.height()) )
+      ++max_level;
+
+   std::error_code error;
+   fs::path const  root = directory;
+   fs::create_directories( root, error );
+   if ( error )
+      return false;
+   if ( std::FILE *file = std::fopen((root / (name + ".dzi")).string().c_str(), "w") ) {
+      std::fprintf( file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                          "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"%u\" Overlap=\"0\" Format=\"png\">\n"
+                          "   <Size Width=\"%zu\" Height=\"%zu\"/>\n"
+                          "</Image>\n",
+                    options.tile_side, Size(map.width()), Size(map.height()) );
+      if ( std::fclose(file) != 0 )
+         return false;
+   }
+   else return false;
+
+   // the current level; at full resolution the colours come straight from the labels (index_colour)
+   Map<Idx>         level_labels { V2u(0,0) };
+   Vec<RGBA>        level_colours;
+   Map<Idx> const  *labels  = &map;
+   Size             width   = map.width(),
+                    height  = map.height();
+   auto const colours_of_row = [&]( Size y ) -> RGBA const* {
+      return level_colours.data() + y * width;
+   };
+
+   static ThreadPool  serial_pool { 1 }; // for the exports within a tile job (no nested parallelism)
+   std::atomic<Bool>  is_ok = true;
+   for ( Size level = max_level + 1;  level-- > 0; ) {
+      Size const  tile_side = options.tile_side,
+                  tiles_x   = (width  + tile_side - 1) / tile_side,
+                  tiles_y   = (height + tile_side - 1) / tile_side;
+      Bool const  is_full   = labels == &map;
+      fs::path const colour_dir = root / (name + "_files")  / std::to_string(level),
+                     label_dir  = root / (name + "_labels") / std::to_string(level);
+      fs::create_directories( colour_dir, error );
+      if ( not error and options.has_label_tiles )
+         fs::create_directories( label_dir, error );
+      if ( error )
+         return false;
+
+      thread_pool.parallel_for( tiles_x * tiles_y, [&]( Idx tile ) {
+         Size const  x_begin   = (tile % tiles_x) * tile_side,
+                     y_begin   = (tile / tiles_x) * tile_side,
+                     x_end     = std::min( x_begin + tile_side, width  ),
+                     y_end     = std::min( y_begin + tile_side, height );
+         Str const   file_name = std::to_string(tile % tiles_x) + "_" + std::to_string(tile / tiles_x) + ".png";
+
+         PngWriter png( (colour_dir / file_name).string(), U32(x_end - x_begin), U32(y_end - y_begin),
+                        PngWriter::ColourType::rgba, 8, options.compression_level );
+         Vec<RGBA> row( x_end - x_begin );
+         for ( Size y = y_begin;  y < y_end;  ++y ) {
+            if ( is_full )
+               apply_index_colours( &map(x_begin,y), row.data(), row.size() );
+            else
+               std::copy( colours_of_row(y) + x_begin, colours_of_row(y) + x_end, row.begin() );
+            png.write_row( reinterpret_cast<Byte const*>(row.data()) );
+         }
+         Bool is_tile_ok = png.finish();
+
+         if ( options.has_label_tiles ) {
+            Map<Idx> tile_labels { V2u(x_end - x_begin, y_end - y_begin) };
+            for ( Size y = y_begin;  y < y_end;  ++y )
+               std::copy( &(*labels)(x_begin,y), &(*labels)(x_begin,y) + (x_end - x_begin), &tile_labels(0, y - y_begin) );
+            is_tile_ok = label_map2png( tile_labels, (label_dir / file_name).string(), options.compression_level, serial_pool )
+                     and is_tile_ok;
+         }
+         if ( not is_tile_ok )
+            is_ok = false;
+      } );
+      if ( level == 0 )
+         break;
+
+      // downsample into the next level:
+      Size const  next_width  = (width  + 1) / 2,
+                  next_height = (height + 1) / 2;
+      Map<Idx>    next_labels { V2u(next_width, next_height) };
+      Vec<RGBA>   next_colours( next_width * next_height );
+      thread_pool.parallel_for( next_height, [&]( Idx y ) {
+         // labels: the most common of each 2x2 block (ties go to the earlier one in reading order)
+         Size const y0 = 2*y,
+                    y1 = std::min( 2*y + 1, height - 1 );
+         for ( Size x = 0;  x < next_width;  ++x ) {
+            Size const x0 = 2*x,
+                       x1 = std::min( 2*x + 1, width - 1 );
+            Idx const  block[4] = { (*labels)(x0,y0), (*labels)(x1,y0), (*labels)(x0,y1), (*labels)(x1,y1) };
+            Idx        mode     = block[0];
+            Size       best     = 0;
+            for ( Idx i = 0;  i < 4;  ++i ) {
+               Size count = 0;
+               for ( Idx j = i;  j < 4;  ++j )
+                  count += block[j] == block[i];
+               if ( count > best ) {
+                  best = count;
+                  mode = block[i];
+               }
+            }
+            next_labels(x,y) = mode;
+         }
+         // colours: a 2:1 box filter over the two source rows (the odd edge column/row is repeated)
+         Vec<RGBA> source( 2 * next_width * 2 );
+         for ( Idx row = 0;  row < 2;  ++row ) {
+            Size const  source_y = row == 0? y0 : y1;
+            RGBA       *dest     = source.data() + row * 2 * next_width;
+            if ( is_full )
+               apply_index_colours( &map(0,source_y), dest, width );
+            else
+               std::copy( colours_of_row(source_y), colours_of_row(source_y) + width, dest );
+            if ( width % 2 )
+               dest[width] = dest[width - 1];
+         }
+         stbir_resize_uint8_generic( reinterpret_cast<unsigned char const*>(source.data()), I32(2 * next_width), 2, I32(2 * next_width * sizeof(RGBA)),
+                                     reinterpret_cast<unsigned char*>(next_colours.data() + y * next_width), I32(next_width), 1, 0,
+                                     4, 3, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_BOX, STBIR_COLORSPACE_SRGB, nullptr );
+      }, 16 );
+      level_labels  = std::move( next_labels );
+      level_colours = std::move( next_colours );
+      labels        = &level_labels;
+      width         = next_width;
+      height        = next_height;
+   }
+   return is_ok;
+}
+
+// EOF
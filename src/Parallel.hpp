@@ -0,0 +1,146 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/AllocationTracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Persistent worker threads for bulk-synchronous loops.
+// parallel_for blocks until every item is done, and the calling thread helps out. Concurrent
+// callers (say, two threads using shared()) take turns; a job that calls parallel_for on the
+// pool running it (on a worker or on the calling thread) gets a serial loop instead, since
+// waiting for the pool would mean waiting for itself.
+class ThreadPool {
+public:
+   explicit ThreadPool( Size thread_count=0 ) { // 0 = one thread per hardware thread
+      if ( thread_count == 0 )
+         thread_count = std::max( 1U, std::thread::hardware_concurrency() );
+      m_workers.reserve( thread_count - 1 );
+      for ( Size i = 1;  i < thread_count;  ++i )
+         m_workers.emplace_back( [this] { worker_loop(); } );
+   }
+
+   ~ThreadPool() {
+      {
+         std::lock_guard lock( m_mutex );
+         m_is_stopping = true;
+      }
+      m_wake.notify_all();
+      for ( auto &worker : m_workers )
+         worker.join();
+   }
+
+   ThreadPool( ThreadPool const & )             = delete;
+   ThreadPool & operator=( ThreadPool const & ) = delete;
+
+   Size thread_count() const {
+      return m_workers.size() + 1;
+   }
+
+   // calls function(index) for every index in [0,count), in chunks of `grain` indices
+   template <typename T_Function>
+   void parallel_for( Size count, T_Function &&function, Size grain=1 ) {
+      if ( count == 0 )
+         return;
+      if ( m_workers.empty() or count <= grain or is_running_job() ) {
+         for ( Idx index = 0;  index < count;  ++index )
+            function( index );
+         return;
+      }
+      std::lock_guard caller_lock( m_caller_mutex ); // one job at a time
+      {
+         std::lock_guard lock( m_mutex );
+         m_job = [&function]( Idx begin, Idx end ) {
+            for ( Idx index = begin;  index < end;  ++index )
+               function( index );
+         };
+         m_job_outer   = t_job_frames;
+         m_job_stage   = AllocationTracker::current_stage();
+         m_count       = count;
+         m_grain       = std::max<Size>( grain, 1 );
+         m_next        = 0;
+         m_busy_count  = m_workers.size();
+         ++m_generation;
+      }
+      m_wake.notify_all();
+      run_chunks();
+      std::unique_lock lock( m_mutex );
+      m_done.wait( lock, [this] { return m_busy_count == 0; } );
+      m_job = nullptr;
+   }
+
+   // process-wide pool used when callers don't provide their own
+   static ThreadPool & shared() {
+      static ThreadPool pool;
+      return pool;
+   }
+
+private:
+   // The pools whose chunks this thread is running, innermost first. A job inherits the frames of
+   // the thread that started it, so pool A -> pool B -> pool A is caught on B's workers too.
+   struct JobFrame {
+      ThreadPool const *pool;
+      JobFrame   const *outer;
+   };
+   static inline thread_local JobFrame const *t_job_frames = nullptr;
+
+   Vec<std::thread>          m_workers;
+   std::mutex                m_caller_mutex, // held for the whole of a parallel_for
+                             m_mutex;
+   std::condition_variable   m_wake,
+                             m_done;
+   Fun<void,Idx,Idx>         m_job;
+   JobFrame const           *m_job_outer  = nullptr; // the frames of the thread running parallel_for
+   char const               *m_job_stage  = nullptr; // its allocation stage, if any
+   Size                      m_count       = 0,
+                             m_grain       = 1,
+                             m_busy_count  = 0;
+   U64                       m_generation  = 0;
+   std::atomic<Size>         m_next        = 0;
+   Bool                      m_is_stopping = false;
+
+   Bool is_running_job() const {
+      for ( auto frame = t_job_frames;  frame;  frame = frame->outer )
+         if ( frame->pool == this )
+            return true;
+      return false;
+   }
+
+   void run_chunks() {
+      JobFrame const frame { this, m_job_outer },
+                    *const own_frames = t_job_frames;
+      t_job_frames = &frame;
+      for ( Idx begin;  (begin = m_next.fetch_add(m_grain)) < m_count; )
+         m_job( begin, std::min(begin + m_grain, m_count) );
+      t_job_frames = own_frames;
+   }
+
+   void worker_loop() {
+      U64 seen_generation = 0;
+      for (;;) {
+         {
+            std::unique_lock lock( m_mutex );
+            m_wake.wait( lock, [&] { return m_is_stopping or m_generation != seen_generation; } );
+            if ( m_is_stopping )
+               return;
+            seen_generation = m_generation;
+         }
+         {
+            // the workers' allocations count towards the stage that started the job
+            Opt<AllocationTracker::ScopedStage> stage;
+            if ( AllocationTracker::is_enabled and m_job_stage )
+               stage.emplace( m_job_stage, true );
+            run_chunks();
+         }
+         std::lock_guard lock( m_mutex );
+         if ( --m_busy_count == 0 )
+            m_done.notify_one();
+      }
+   }
+};
+
+// EOF
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/PngWriter.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+// Streaming PNG decoder for the non-interlaced images written by PngWriter:
+// the header and every chunk before the image data are read on construction,
+// after which rows are inflated and unfiltered one at a time (read_row).
+class PngReader {
+public:
+   using ColourType = PngWriter::ColourType;
+
+   PngReader( Str const &path ):
+      m_file ( std::fopen(path.c_str(), "rb") )
+   {
+      Byte signature[8];
+      Byte constexpr expected[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+      m_is_ok = m_file and read( signature, 8 ) and std::memcmp( signature, expected, 8 ) == 0
+            and inflateInit( &m_stream ) == Z_OK;
+      m_has_stream = m_is_ok;
+      // read the chunks up to (and including) the first IDAT chunk:
+      while ( m_is_ok and next_chunk() and std::memcmp(m_chunk_type, "IDAT", 4) != 0 ) {
+         if ( std::memcmp(m_chunk_type, "IHDR", 4) == 0 and m_chunk.size() == 13 ) {
+            m_width       = get_u32( m_chunk.data()   );
+            m_height      = get_u32( m_chunk.data()+4 );
+            m_bit_depth   = m_chunk[8];
+            m_colour_type = static_cast<ColourType>( m_chunk[9] );
+            m_is_ok       = m_chunk[12] == 0; // interlacing is not supported
+         }
+         else if ( std::memcmp(m_chunk_type, "PLTE", 4) == 0 ) {
+            for ( Size i = 0;  i + 2 < m_chunk.size();  i += 3 )
+               m_palette.push_back( 0xFF'000000u | (U32(m_chunk[i+2]) << 16) | (U32(m_chunk[i+1]) << 8) | m_chunk[i] );
+         }
+         else m_ancillary_chunks.push_back({ Str(m_chunk_type, 4), m_chunk });
+      }
+      m_is_ok = m_is_ok and m_width > 0 and std::memcmp( m_chunk_type, "IDAT", 4 ) == 0;
+      m_stream.next_in  = m_chunk.data();
+      m_stream.avail_in = static_cast<uInt>( m_chunk.size() );
+      Size channels = 0;
+      switch ( m_colour_type ) {
+         case ColourType::grey:       channels = 1;  break;
+         case ColourType::rgb:        channels = 3;  break;
+         case ColourType::palette:    channels = 1;  break;
+         case ColourType::grey_alpha: channels = 2;  break;
+         case ColourType::rgba:       channels = 4;  break;
+      }
+      m_pixel_bytes = std::max<Size>( 1, channels * m_bit_depth / 8 );
+      m_row_bytes   = ( Size(m_width) * channels * m_bit_depth + 7 ) / 8;
+      m_previous.assign( m_row_bytes, 0 );
+      m_filtered.resize( m_row_bytes + 1 );
+   }
+
+   ~PngReader() {
+      if ( m_has_stream )
+         inflateEnd( &m_stream );
+      if ( m_file )
+         std::fclose( m_file );
+   }
+
+   PngReader( PngReader const & )             = delete;
+   PngReader & operator=( PngReader const & ) = delete;
+
+   Bool        is_ok()       const { return m_is_ok;       }
+   U32         width()       const { return m_width;       }
+   U32         height()      const { return m_height;      }
+   U8          bit_depth()   const { return m_bit_depth;   }
+   ColourType  colour_type() const { return m_colour_type; }
+   Size        row_bytes()   const { return m_row_bytes;   }
+
+   // packed like RGBA pixels (R in the low byte), opaque
+   Vec<U32> const& palette() const {
+      return m_palette;
+   }
+
+   // the data of an ancillary chunk that preceded the image data
+   Opt<Vec<Byte>> ancillary_chunk( char const type[4] ) const {
+      for ( auto const &[chunk_type,data] : m_ancillary_chunks )
+         if ( std::memcmp(chunk_type.data(), type, 4) == 0 )
+            return data;
+      return {};
+   }
+
+   // the next row of raw pixel data (row_bytes() long, multi-byte samples big-endian)
+   Bool read_row( Byte *row ) {
+      if ( not m_is_ok or m_rows_read == m_height )
+         return false;
+      m_stream.next_out  = m_filtered.data();
+      m_stream.avail_out = static_cast<uInt>( m_filtered.size() );
+      while ( m_is_ok and m_stream.avail_out > 0 ) {
+         if ( m_stream.avail_in == 0 ) { // refill from the next IDAT chunk
+            m_is_ok = next_chunk() and std::memcmp( m_chunk_type, "IDAT", 4 ) == 0;
+            m_stream.next_in  = m_chunk.data();
+            m_stream.avail_in = static_cast<uInt>( m_chunk.size() );
+            continue;
+         }
+         I32 result = inflate( &m_stream, Z_NO_FLUSH );
+         m_is_ok = ( result == Z_OK or (result == Z_STREAM_END and m_stream.avail_out == 0) );
+      }
+      if ( not m_is_ok )
+         return false;
+      unfilter( row );
+      std::copy( row, row + m_row_bytes, m_previous.begin() );
+      ++m_rows_read;
+      return true;
+   }
+
+private:
+   std::FILE                      *m_file;
+   Bool                            m_is_ok       = false,
+                                   m_has_stream  = false;
+   U32                             m_width       = 0,
+                                   m_height      = 0,
+                                   m_rows_read   = 0;
+   U8                              m_bit_depth   = 8;
+   ColourType                      m_colour_type = ColourType::rgba;
+   Size                            m_pixel_bytes = 0,
+                                   m_row_bytes   = 0;
+   Vec<U32>                        m_palette;
+   Vec<std::pair<Str,Vec<Byte>>>   m_ancillary_chunks;
+   char                            m_chunk_type[4] = {};
+   Vec<Byte>                       m_chunk;     // data of the current chunk
+   Vec<Byte>                       m_previous;  // previous unfiltered row
+   Vec<Byte>                       m_filtered;  // current row with its filter byte
+   z_stream                        m_stream = {};
+
+   static U32 get_u32( Byte const *src ) {
+      return (U32(src[0]) << 24) | (U32(src[1]) << 16) | (U32(src[2]) << 8) | U32(src[3]);
+   }
+
+   Bool read( void *dest, Size size ) {
+      return std::fread( dest, 1, size, m_file ) == size;
+   }
+
+   // reads the next chunk into m_chunk_type and m_chunk, verifying its CRC
+   Bool next_chunk() {
+      Byte length[4], crc[4];
+      if ( not read(length, 4) or not read(m_chunk_type, 4) )
+         return false;
+      m_chunk.resize( get_u32(length) );
+      if ( not read(m_chunk.data(), m_chunk.size()) or not read(crc, 4) )
+         return false;
+      uLong checksum = crc32( 0, reinterpret_cast<Bytef const*>(m_chunk_type), 4 );
+      checksum = crc32( checksum, m_chunk.data(), static_cast<uInt>(m_chunk.size()) );
+      return checksum == get_u32( crc );
+   }
+
+   void unfilter( Byte *row ) const {
+      Byte const         filter = m_filtered[0];
+      Byte const *const  in     = m_filtered.data() + 1;
+      Byte const *const  up     = m_previous.data();
+      Size const         bpp    = m_pixel_bytes;
+      for ( Size i = 0;  i < m_row_bytes;  ++i ) {
+         I32 const  a = i >= bpp? row[i-bpp] : 0,
+                    b = up[i],
+                    c = i >= bpp? up[i-bpp]  : 0;
+         I32 predictor = 0;
+         switch ( filter ) {
+            case 1: predictor = a;            break; // sub
+            case 2: predictor = b;            break; // up
+            case 3: predictor = (a + b) / 2;  break; // average
+            case 4: {                                // paeth
+               I32 const p  = a + b - c,
+                         pa = std::abs(p - a),
+                         pb = std::abs(p - b),
+                         pc = std::abs(p - c);
+               predictor = (pa <= pb and pa <= pc)? a : (pb <= pc? b : c);
+            } break;
+         }
+         row[i] = static_cast<Byte>( in[i] + predictor );
+      }
+   }
+};
+
+// EOF
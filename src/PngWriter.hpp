@@ -0,0 +1,320 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/Parallel.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <zlib.h>
+
+// Streaming PNG encoder: rows are filtered and deflated as they come in, and the
+// compressed stream is written out in IDAT chunks of a fixed size, so peak memory
+// only depends on the image width (never on its height).
+// Rows can either be pushed one at a time (write_row) or pulled in parallel (write_rows_parallel).
+class PngWriter {
+public:
+   enum class ColourType : U8 { grey=0, rgb=2, palette=3, grey_alpha=4, rgba=6 };
+
+   static constexpr Size idat_capacity = 1 << 16; // bytes per IDAT chunk
+
+   PngWriter( Str const &path, U32 width, U32 height, ColourType colour_type, U8 bit_depth=8,
+              I32 compression_level=Z_DEFAULT_COMPRESSION ):
+      m_file        ( std::fopen(path.c_str(), "wb") ),
+      m_height      ( height ),
+      m_pixel_bytes ( std::max<Size>(1, channel_count(colour_type) * bit_depth / 8) ),
+      m_row_bytes   ( (Size(width) * channel_count(colour_type) * bit_depth + 7) / 8 ),
+      m_previous    ( m_row_bytes, 0 ),
+      m_filtered    ( 5, Vec<Byte>(m_row_bytes + 1) ),
+      m_idat        ( idat_capacity ),
+      m_compression_level ( compression_level )
+   {
+      m_is_ok = m_file != nullptr and width > 0 and height > 0; // PNG has no empty images
+      Byte constexpr signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+      write( signature, sizeof signature );
+      Byte header[13];
+      put_u32( header+0, width );
+      put_u32( header+4, height );
+      header[8]  = bit_depth;
+      header[9]  = static_cast<Byte>( colour_type );
+      header[10] = 0; // deflate
+      header[11] = 0; // adaptive filtering
+      header[12] = 0; // no interlacing
+      write_chunk( "IHDR", header, sizeof header );
+   }
+
+   ~PngWriter() {
+      finish();
+   }
+
+   PngWriter( PngWriter const & )             = delete;
+   PngWriter & operator=( PngWriter const & ) = delete;
+
+   // palette entries packed like RGBA pixels (R in the low byte; alpha is ignored);
+   // must be written before the first row
+   void write_palette( Vec<RGBA> const &colours ) {
+      assert( m_rows_written == 0 and colours.size() <= 256 );
+      Vec<Byte> data( colours.size() * 3 );
+      for ( Idx i = 0;  i < colours.size();  ++i ) {
+         data[i*3+0] = static_cast<Byte>( colours[i]       );
+         data[i*3+1] = static_cast<Byte>( colours[i] >>  8 );
+         data[i*3+2] = static_cast<Byte>( colours[i] >> 16 );
+      }
+      write_chunk( "PLTE", data.data(), data.size() );
+   }
+
+   // an extra (ancillary) chunk; must be written before the first row
+   void write_ancillary_chunk( char const type[4], Vec<Byte> const &data ) {
+      assert( m_rows_written == 0 and type[0] >= 'a' and type[0] <= 'z' );
+      write_chunk( type, data.data(), data.size() );
+   }
+
+   // one row of raw (unfiltered) pixel data, row_bytes() long, multi-byte samples big-endian
+   void write_row( Byte const *row ) {
+      assert( m_rows_written < m_height );
+      if ( m_rows_written == 0 and m_is_ok ) {
+         m_is_ok      = deflateInit( &m_stream, m_compression_level ) == Z_OK;
+         m_has_stream = m_is_ok;
+      }
+      deflate_bytes( filter_row(row, m_previous.data(), m_row_bytes, m_pixel_bytes, m_filtered), m_row_bytes + 1, Z_NO_FLUSH );
+      std::copy( row, row + m_row_bytes, m_previous.begin() );
+      if ( ++m_rows_written == m_height )
+         finish();
+   }
+
+   // Writes all rows, pulling raw row y from fill_row(y, row) (row_bytes() long). The image is
+   // cut into stripes that are filtered and deflated concurrently into raw deflate streams,
+   // each ending on a byte-aligned sync flush so they concatenate into one valid zlib stream
+   // (the pigz technique). Stripes are processed in batches, so memory stays bounded.
+   template <typename T_FillRow>
+   Bool write_rows_parallel( T_FillRow &&fill_row, ThreadPool &thread_pool = ThreadPool::shared(), Size rows_per_stripe=64 ) {
+      assert( m_rows_written == 0 );
+      if ( m_height == 0 )
+         return finish(); // fails: there would be no deflate block to end the stream
+      struct Stripe {
+         Vec<Byte>  compressed;
+         uLong      adler  = 1;
+         Size       length = 0; // uncompressed bytes
+         Bool       is_ok  = true;
+      };
+      Size const  stripe_count      = (m_height + rows_per_stripe - 1) / rows_per_stripe,
+                  stripes_per_batch = 2 * thread_pool.thread_count();
+      Vec<Stripe> stripes( std::min(stripe_count, stripes_per_batch) );
+
+      // zlib header (deflate, 32K window, level hint)
+      Byte header[2] = { 0x78, 0 };
+      I32  level     = m_compression_level == Z_DEFAULT_COMPRESSION? 6 : m_compression_level;
+      header[1]  = static_cast<Byte>( (level < 2? 0 : level < 6? 1 : level == 6? 2 : 3) << 6 );
+      header[1] += static_cast<Byte>( 31 - (header[0] * 256 + header[1]) % 31 );
+      append_idat( header, 2 );
+
+      uLong adler = 1;
+      for ( Idx batch_begin = 0;  batch_begin < stripe_count;  batch_begin += stripes_per_batch ) {
+         Size const batch_size = std::min( stripes_per_batch, stripe_count - batch_begin );
+         thread_pool.parallel_for( batch_size, [&]( Idx i ) {
+            Idx const  stripe_index = batch_begin + i;
+            Size const y_begin      = stripe_index * rows_per_stripe,
+                       y_end        = std::min<Size>( y_begin + rows_per_stripe, m_height );
+            auto      &stripe       = stripes[i];
+            stripe.compressed.clear();
+            stripe.adler  = adler32( 0, nullptr, 0 );
+            stripe.length = 0;
+
+            Vec<Byte>       previous( m_row_bytes, 0 ),
+                            current ( m_row_bytes );
+            Vec<Vec<Byte>>  filtered( 5, Vec<Byte>(m_row_bytes + 1) );
+            if ( y_begin > 0 )
+               fill_row( y_begin - 1, previous.data() );
+
+            z_stream stream = {};
+            stripe.is_ok = deflateInit2( &stream, m_compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) == Z_OK;
+            if ( not stripe.is_ok )
+               return;
+            Bool const is_last = y_end == m_height;
+            for ( Size y = y_begin;  y < y_end;  ++y ) {
+               fill_row( y, current.data() );
+               Byte const *row = filter_row( current.data(), previous.data(), m_row_bytes, m_pixel_bytes, filtered );
+               stripe.adler   = adler32( stripe.adler, row, static_cast<uInt>(m_row_bytes + 1) );
+               stripe.length += m_row_bytes + 1;
+               I32 const flush = y + 1 < y_end? Z_NO_FLUSH : (is_last? Z_FINISH : Z_SYNC_FLUSH);
+               stream.next_in  = const_cast<Bytef*>( row );
+               stream.avail_in = static_cast<uInt>( m_row_bytes + 1 );
+               do {
+                  Size const old_size = stripe.compressed.size();
+                  stripe.compressed.resize( old_size + m_row_bytes + 64 );
+                  stream.next_out  = stripe.compressed.data() + old_size;
+                  stream.avail_out = static_cast<uInt>( m_row_bytes + 64 );
+                  stripe.is_ok = deflate( &stream, flush ) != Z_STREAM_ERROR and stripe.is_ok;
+                  stripe.compressed.resize( old_size + m_row_bytes + 64 - stream.avail_out );
+               } while ( stream.avail_in > 0 or stream.avail_out == 0 );
+               previous.swap( current );
+            }
+            deflateEnd( &stream );
+         } );
+         // append the batch in order
+         for ( Idx i = 0;  i < batch_size;  ++i ) {
+            m_is_ok = stripes[i].is_ok and m_is_ok;
+            append_idat( stripes[i].compressed.data(), stripes[i].compressed.size() );
+            adler = adler32_combine( adler, stripes[i].adler, static_cast<z_off_t>(stripes[i].length) );
+         }
+      }
+
+      Byte trailer[4];
+      put_u32( trailer, static_cast<U32>(adler) );
+      append_idat( trailer, 4 );
+      m_rows_written = m_height;
+      return finish();
+   }
+
+   // flushes the remaining compressed data and closes the file; returns whether everything succeeded
+   Bool finish() {
+      if ( m_file ) {
+         if ( m_has_stream ) {
+            deflate_bytes( nullptr, 0, Z_FINISH );
+            deflateEnd( &m_stream );
+            m_has_stream = false;
+         }
+         flush_idat();
+         m_is_ok = m_is_ok and m_rows_written == m_height;
+         write_chunk( "IEND", nullptr, 0 );
+         m_is_ok = (std::fclose(m_file) == 0) and m_is_ok;
+         m_file  = nullptr;
+      }
+      return m_is_ok;
+   }
+
+   Bool is_ok() const {
+      return m_is_ok;
+   }
+
+   Size row_bytes() const {
+      return m_row_bytes;
+   }
+
+private:
+   std::FILE       *m_file;
+   U32              m_height,
+                    m_rows_written = 0;
+   Size             m_pixel_bytes,
+                    m_row_bytes;
+   Vec<Byte>        m_previous;  // the previous raw row (for filtering)
+   Vec<Vec<Byte>>   m_filtered;  // the current row under each of the 5 filters (with filter byte)
+   Vec<Byte>        m_idat;      // pending compressed bytes
+   Size             m_idat_size  = 0;
+   I32              m_compression_level;
+   z_stream         m_stream     = {};
+   Bool             m_is_ok      = false,
+                    m_has_stream = false;
+
+   static Size channel_count( ColourType colour_type ) {
+      switch ( colour_type ) {
+         case ColourType::grey:       return 1;
+         case ColourType::rgb:        return 3;
+         case ColourType::palette:    return 1;
+         case ColourType::grey_alpha: return 2;
+         case ColourType::rgba:       return 4;
+      }
+      return 0;
+   }
+
+   static void put_u32( Byte *dest, U32 value ) {
+      dest[0] = static_cast<Byte>( value >> 24 );
+      dest[1] = static_cast<Byte>( value >> 16 );
+      dest[2] = static_cast<Byte>( value >>  8 );
+      dest[3] = static_cast<Byte>( value       );
+   }
+
+   void write( void const *data, Size size ) {
+      if ( m_file and size > 0 )
+         m_is_ok = (std::fwrite(data, 1, size, m_file) == size) and m_is_ok;
+   }
+
+   void write_chunk( char const type[4], Byte const *data, Size size ) {
+      Byte length[4], crc[4];
+      put_u32( length, static_cast<U32>(size) );
+      uLong checksum = crc32( 0, reinterpret_cast<Bytef const*>(type), 4 );
+      if ( size > 0 )
+         checksum = crc32( checksum, data, static_cast<uInt>(size) );
+      put_u32( crc, static_cast<U32>(checksum) );
+      write( length, 4 );
+      write( type,   4 );
+      write( data,   size );
+      write( crc,    4 );
+   }
+
+   void flush_idat() {
+      if ( m_idat_size > 0 )
+         write_chunk( "IDAT", m_idat.data(), m_idat_size );
+      m_idat_size = 0;
+   }
+
+   void append_idat( Byte const *data, Size size ) {
+      while ( size > 0 ) {
+         Size const count = std::min( size, idat_capacity - m_idat_size );
+         std::copy( data, data + count, m_idat.data() + m_idat_size );
+         m_idat_size += count;
+         data        += count;
+         size        -= count;
+         if ( m_idat_size == idat_capacity )
+            flush_idat();
+      }
+   }
+
+   void deflate_bytes( Byte const *data, Size size, I32 flush ) {
+      if ( not m_has_stream )
+         return;
+      m_stream.next_in  = const_cast<Bytef*>( data );
+      m_stream.avail_in = static_cast<uInt>( size );
+      do {
+         m_stream.next_out  = m_idat.data() + m_idat_size;
+         m_stream.avail_out = static_cast<uInt>( idat_capacity - m_idat_size );
+         I32 result = deflate( &m_stream, flush );
+         m_is_ok = (result != Z_STREAM_ERROR) and m_is_ok;
+         m_idat_size = idat_capacity - m_stream.avail_out;
+         if ( m_idat_size == idat_capacity )
+            flush_idat();
+      } while ( m_stream.avail_in > 0 or (flush == Z_FINISH and m_stream.avail_out == 0) );
+   }
+
+   // applies all five PNG filters and returns the one with the lowest sum of absolute
+   // (signed) residuals; the same heuristic as stb_image_write and libpng
+   static Byte const* filter_row( Byte const *row, Byte const *up, Size row_bytes, Size bpp, Vec<Vec<Byte>> &filtered ) {
+      U64                best_score  = std::numeric_limits<U64>::max();
+      Idx                best_filter = 0;
+      for ( Idx filter = 0;  filter < 5;  ++filter ) {
+         Byte *out = filtered[filter].data();
+         out[0] = static_cast<Byte>( filter );
+         U64 score = 0;
+         for ( Size i = 0;  i < row_bytes;  ++i ) {
+            I32 const  a = i >= bpp? row[i-bpp] : 0,
+                       b = up[i],
+                       c = i >= bpp? up[i-bpp]  : 0;
+            I32 predictor = 0;
+            switch ( filter ) {
+               case 0: predictor = 0;            break; // none
+               case 1: predictor = a;            break; // sub
+               case 2: predictor = b;            break; // up
+               case 3: predictor = (a + b) / 2;  break; // average
+               case 4: {                                // paeth
+                  I32 const p  = a + b - c,
+                            pa = std::abs(p - a),
+                            pb = std::abs(p - b),
+                            pc = std::abs(p - c);
+                  predictor = (pa <= pb and pa <= pc)? a : (pb <= pc? b : c);
+               } break;
+            }
+            Byte const residual = static_cast<Byte>( row[i] - predictor );
+            out[i+1] = residual;
+            score   += std::abs( static_cast<I8>(residual) );
+         }
+         if ( score < best_score ) {
+            best_score  = score;
+            best_filter = filter;
+         }
+      }
+      return filtered[best_filter].data();
+   }
+};
+
+// EOF
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/RNG.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+// Poisson-disk (blue noise) point set: no two points are closer than min_distance, and no point
+// can be added without violating that. Bridson's algorithm ("Fast Poisson Disk Sampling in
+// Arbitrary Dimensions", 2007): a background grid with at most one point per cell makes every
+// distance check O(1), so sampling is O(n). Tiled sampling measures distances across the wrapped
+// map edges, so the set stays blue noise when the map is repeated (as with Voronoi<true>).
+template <Bool T_is_tiled = false>
+Vec<V2f> poisson_disk_sample( V2f dimensions, F32 min_distance, RNG::Engine &rng_engine, Size attempts_per_point=30 ) {
+   assert( min_distance > .0f and dimensions.x > .0f and dimensions.y > .0f );
+
+   // cells no wider than min_distance/sqrt(2) hold at most one point; for tiling, they must
+   // also divide the map exactly
+   Size const  columns     = std::max<Size>( 1, std::ceil(dimensions.x * std::numbers::sqrt2_v<F32> / min_distance) ),
+               rows        = std::max<Size>( 1, std::ceil(dimensions.y * std::numbers::sqrt2_v<F32> / min_distance) );
+   V2f const   cell_size   = { dimensions.x / columns, dimensions.y / rows };
+   I32 const   reach_x     = static_cast<I32>( std::ceil(min_distance / cell_size.x) ),
+               reach_y     = static_cast<I32>( std::ceil(min_distance / cell_size.y) );
+   F32 const   min_squared = min_distance * min_distance;
+
+   // cell -> its point (if any); positions are stored in the grid itself so the neighbourhood
+   // checks read contiguous memory instead of chasing indices
+   V2f const  empty = { std::numeric_limits<F32>::infinity(), std::numeric_limits<F32>::infinity() };
+   Vec<V2f>   points;
+   Vec<V2f>   grid( columns * rows, empty );
+   Vec<Idx>   active;
+   points.reserve( Size(dimensions.x * dimensions.y / min_squared) );
+
+   auto const cell_of = [&]( V2f p ) -> Idx {
+      Size const x = std::min<Size>( p.x / cell_size.x, columns - 1 ),
+                 y = std::min<Size>( p.y / cell_size.y, rows    - 1 );
+      return y * columns + x;
+   };
+   auto const wrap = [&]( F32 value, F32 extent ) {
+      value -= std::floor( value / extent ) * extent;
+      return value < extent? value : .0f; // rounding may land exactly on the extent
+   };
+   // the grid offsets that may hold a point closer than min_distance, nearest first (for early exits)
+   Vec<Arr<I32,2>> offsets;
+   for ( I32 y = -reach_y;  y <= reach_y;  ++y ) {
+      for ( I32 x = -reach_x;  x <= reach_x;  ++x ) {
+         F32 const gap_x = std::max( 0, std::abs(x) - 1 ) * cell_size.x,
+                   gap_y = std::max( 0, std::abs(y) - 1 ) * cell_size.y;
+         if ( gap_x*gap_x + gap_y*gap_y < min_squared )
+            offsets.push_back({ x, y });
+      }
+   }
+   std::sort( offsets.begin(), offsets.end(), []( auto const &lhs, auto const &rhs ) {
+      return std::abs(lhs[0]) + std::abs(lhs[1]) < std::abs(rhs[0]) + std::abs(rhs[1]);
+   } );
+
+   auto const is_far_enough = [&]( V2f p ) {
+      Idx const cell = cell_of( p );
+      I32 const cx   = static_cast<I32>( cell % columns ),
+                cy   = static_cast<I32>( cell / columns );
+      for ( auto const &[ox,oy] : offsets ) {
+         I32 gx = cx + ox,
+             gy = cy + oy;
+         if constexpr ( T_is_tiled ) { // offsets never exceed the grid, unless it is tiny
+            while ( gx < 0 )              gx += I32(columns);
+            while ( gx >= I32(columns) )  gx -= I32(columns);
+            while ( gy < 0 )              gy += I32(rows);
+            while ( gy >= I32(rows) )     gy -= I32(rows);
+         }
+         else if ( gx < 0 or gy < 0 or gx >= I32(columns) or gy >= I32(rows) )
+            continue;
+         V2f const other = grid[ gy * columns + gx ];
+         F32 dx = std::abs( other.x - p.x ), // infinite for empty cells
+             dy = std::abs( other.y - p.y );
+         if constexpr ( T_is_tiled ) {
+            dx = std::min( dx, dimensions.x - dx );
+            dy = std::min( dy, dimensions.y - dy );
+         }
+         if ( dx*dx + dy*dy < min_squared )
+            return false;
+      }
+      return true;
+   };
+   auto const add = [&]( V2f p ) {
+      grid[ cell_of(p) ] = p;
+      active.push_back( points.size() );
+      points.push_back( p );
+   };
+
+   RNG::Real<F32> unit { rng_engine, .0f, 1.0f };
+   add( V2f( unit() * dimensions.x, unit() * dimensions.y ) );
+   while ( not active.empty() ) {
+      Idx const  active_index = std::min<Idx>( unit() * active.size(), active.size() - 1 );
+      V2f const  origin       = points[ active[active_index] ];
+      Bool       is_found     = false;
+      for ( Size attempt = 0;  attempt < attempts_per_point and not is_found;  ++attempt ) {
+         // uniform by area in the annulus [min_distance, 2*min_distance)
+         F32 const radius = min_distance * std::sqrt( 1.0f + 3.0f * unit() ),
+                   angle  = 2.0f * std::numbers::pi_v<F32> * unit();
+         V2f candidate    = { origin.x + radius * std::cos(angle), origin.y + radius * std::sin(angle) };
+         if constexpr ( T_is_tiled ) {
+            candidate.x = wrap( candidate.x, dimensions.x );
+            candidate.y = wrap( candidate.y, dimensions.y );
+         }
+         else if ( candidate.x < .0f or candidate.y < .0f or candidate.x >= dimensions.x or candidate.y >= dimensions.y )
+            continue;
+         if ( is_far_enough(candidate) ) {
+            add( candidate );
+            is_found = true;
+         }
+      }
+      if ( not is_found ) { // exhausted; retire it
+         active[active_index] = active.back();
+         active.pop_back();
+      }
+   }
+   return points;
+}
+
+// The min_distance that yields about point_count points on a map of the given dimensions
+// (the sets produced above hold about 0.615 points per min_distance^2 of area).
+inline F32 poisson_disk_distance_for( V2f dimensions, Size point_count ) {
+   assert( point_count > 0 );
+   return std::sqrt( .615f * dimensions.x * dimensions.y / point_count );
+}
+
+// EOF
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/AllocationTracker.hpp"
+#include "falk/StringHash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+// Scoped-zone profiler. DV_PROFILE_ZONE("name") times the rest of the enclosing scope.
+// Every thread records into its own ring buffer (no locks or shared cache lines on the hot path),
+// so zones may be used inside parallel_for jobs. Zones are meant for stages, not per-pixel work:
+// one costs two clock reads and a store (about 80 ns, measured in a tight loop).
+// Compiled out entirely unless DV1478_PROFILE is defined (see the CMake option of that name).
+// Reports (print_summary, write_chrome_trace) must only be made while no zones are running.
+namespace Profiler {
+#ifdef DV1478_PROFILE
+   Bool constexpr is_enabled = true;
+#else
+   Bool constexpr is_enabled = false;
+#endif
+
+   struct ZoneEvent {
+      char const  *name;     // must outlive the profiler (string literals)
+      U64          begin_ns; // since the profiler's epoch
+      U64          end_ns;
+   };
+
+   // one thread's events; the oldest are overwritten once `capacity` is exceeded
+   class ThreadBuffer {
+   public:
+      static constexpr Size capacity = 1 << 14;
+
+      explicit ThreadBuffer( U32 thread_id ):
+         m_thread_id ( thread_id ),
+         m_events    ( std::make_unique<ZoneEvent[]>(capacity) )
+      {}
+
+      void push( ZoneEvent const &event ) {
+         U64 const count = m_count.load( std::memory_order_relaxed );
+         m_events[ count % capacity ] = event;
+         m_count.store( count + 1, std::memory_order_release );
+      }
+
+      template <typename T_Visitor>
+      void for_each( T_Visitor &&visit ) const {
+         U64 const count = m_count.load( std::memory_order_acquire );
+         for ( U64 i = count > capacity? count - capacity : 0;  i < count;  ++i )
+            visit( m_events[i % capacity] );
+      }
+
+      U64 dropped() const {
+         U64 const count = m_count.load( std::memory_order_acquire );
+         return count > capacity? count - capacity : 0;
+      }
+
+      U32 thread_id() const {
+         return m_thread_id;
+      }
+
+   private:
+      U32                     m_thread_id;
+      UPtr<ZoneEvent[]>       m_events;
+      std::atomic<U64>        m_count = 0;
+   };
+
+   // all thread buffers; they are kept until exit so that reports can include finished threads
+   class Registry {
+   public:
+      static Registry & instance() {
+         static Registry registry;
+         return registry;
+      }
+
+      ThreadBuffer & local_buffer() {
+         thread_local ThreadBuffer *buffer = register_thread();
+         return *buffer;
+      }
+
+      U64 now_ns() const {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - m_epoch ).count();
+      }
+
+      template <typename T_Visitor>
+      void for_each_buffer( T_Visitor &&visit ) {
+         std::lock_guard lock( m_mutex );
+         for ( auto const &buffer : m_buffers )
+            visit( *buffer );
+      }
+
+   private:
+      using Clock = std::chrono::steady_clock;
+
+      std::mutex               m_mutex;
+      Vec<UPtr<ThreadBuffer>>  m_buffers;
+      Clock::time_point        m_epoch = Clock::now();
+
+      ThreadBuffer * register_thread() {
+         std::lock_guard lock( m_mutex );
+         m_buffers.push_back( std::make_unique<ThreadBuffer>(U32(m_buffers.size())) );
+         return m_buffers.back().get();
+      }
+   };
+
+   class ScopedZone {
+   public:
+      explicit ScopedZone( char const *name ):
+         m_name     ( name ),
+         m_begin_ns ( Registry::instance().now_ns() )
+      {}
+
+      ~ScopedZone() {
+         auto &registry = Registry::instance();
+         registry.local_buffer().push({ m_name, m_begin_ns, registry.now_ns() });
+      }
+
+      ScopedZone( ScopedZone const & )             = delete;
+      ScopedZone & operator=( ScopedZone const & ) = delete;
+
+   private:
+      char const  *m_name;
+      U64          m_begin_ns;
+   };
+
+   // per-zone totals, sorted by total time (descending)
+   inline void print_summary( std::FILE *out = stderr ) {
+      if constexpr ( not is_enabled )
+         return;
+      struct Stats { char const *name; U64 count = 0, total_ns = 0, min_ns = ~U64(0), max_ns = 0; };
+      StrHashMap<Stats> stats_of;
+      U64 dropped = 0;
+      Registry::instance().for_each_buffer( [&]( ThreadBuffer const &buffer ) {
+         dropped += buffer.dropped();
+         buffer.for_each( [&]( ZoneEvent const &event ) {
+            auto &stats = stats_of[event.name];
+            U64 const duration = event.end_ns - event.begin_ns;
+            stats.name      = event.name;
+            stats.count    += 1;
+            stats.total_ns += duration;
+            stats.min_ns    = std::min( stats.min_ns, duration );
+            stats.max_ns    = std::max( stats.max_ns, duration );
+         } );
+      } );
+      Vec<Stats> sorted;
+      for ( auto const &[name,stats] : stats_of )
+         sorted.push_back( stats );
+      std::sort( sorted.begin(), sorted.end(), []( auto const &lhs, auto const &rhs ) { return lhs.total_ns > rhs.total_ns; } );
+
+      std::fprintf( out, "%-36s %8s %12s %12s %12s %12s\n", "zone", "count", "total ms", "mean ms", "min ms", "max ms" );
+      for ( auto const &stats : sorted )
+         std::fprintf( out, "%-36s %8llu %12.3f %12.3f %12.3f %12.3f\n", stats.name, (unsigned long long) stats.count,
+                       stats.total_ns * 1e-6, stats.total_ns * 1e-6 / stats.count, stats.min_ns * 1e-6, stats.max_ns * 1e-6 );
+      if ( dropped )
+         std::fprintf( out, "(%llu older zones were overwritten and are missing above)\n", (unsigned long long) dropped );
+   }
+
+   // Chrome trace event format; open in chrome://tracing or https://ui.perfetto.dev
+   inline Bool write_chrome_trace( Str const &path ) {
+      if constexpr ( not is_enabled )
+         return true;
+      std::FILE *file = std::fopen( path.c_str(), "w" );
+      if ( not file )
+         return false;
+      std::fprintf( file, "{\"traceEvents\":[\n" );
+      Bool is_first = true;
+      Registry::instance().for_each_buffer( [&]( ThreadBuffer const &buffer ) {
+         buffer.for_each( [&]( ZoneEvent const &event ) {
+            std::fprintf( file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                          is_first? "" : ",\n", event.name, buffer.thread_id(),
+                          event.begin_ns * 1e-3, (event.end_ns - event.begin_ns) * 1e-3 );
+            is_first = false;
+         } );
+      } );
+      std::fprintf( file, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+      return std::fclose( file ) == 0;
+   }
+}
+
+#define DV_PROFILE_CONCAT_IMPL( a, b )  a##b
+#define DV_PROFILE_CONCAT( a, b )       DV_PROFILE_CONCAT_IMPL( a, b )
+#ifdef DV1478_PROFILE
+   #define DV_PROFILE_TIMER( name )        Profiler::ScopedZone DV_PROFILE_CONCAT( profile_zone_, __LINE__ ) { name }
+#else
+   #define DV_PROFILE_TIMER( name )
+#endif
+#ifdef DV1478_TRACK_ALLOCATIONS
+   #define DV_PROFILE_ALLOCATIONS( name )  AllocationTracker::ScopedStage DV_PROFILE_CONCAT( allocation_stage_, __LINE__ ) { name }
+#else
+   #define DV_PROFILE_ALLOCATIONS( name )
+#endif
+// a profiler zone and, with DV1478_TRACK_ALLOCATIONS, an allocation tracking stage
+#define DV_PROFILE_ZONE( name )         DV_PROFILE_TIMER( name ); DV_PROFILE_ALLOCATIONS( name )
+
+// EOF
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/Parallel.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <compare>
+
+// Connected components (4-connectivity) of the regions of a label map, with incremental
+// updates when pixels change owner. Follows the scheme of stb_connected_components.h:
+// the map is split into clusters, each cluster labels its own "clumps" (components within
+// the cluster) and links them to the clumps they touch across its east and south borders,
+// and a global union-find over the clumps joins them along these links.
+// A change only relabels its own cluster and relinks the borders around it; the global join
+// only walks clumps and links, never pixels. Batch several changes between begin_batch()
+// and end_batch() to join only once.
+// The label map is referenced, not copied, and set_label() writes through to it.
+template <Bool T_is_tiled = false>
+class RegionConnectivity {
+public:
+   static constexpr Size cluster_side = 64;
+
+   RegionConnectivity( Map<Idx> &labels, ThreadPool &thread_pool = ThreadPool::shared() ):
+      m_labels         ( labels ),
+      m_clusters_x     ( (labels.width()  + cluster_side - 1) / cluster_side ),
+      m_clusters_y     ( (labels.height() + cluster_side - 1) / cluster_side ),
+      m_clump_of       ( labels.width() * labels.height() ),
+      m_clump_labels   ( m_clusters_x * m_clusters_y ),
+      m_east_links     ( m_clusters_x * m_clusters_y ),
+      m_south_links    ( m_clusters_x * m_clusters_y ),
+      m_is_dirty       ( m_clusters_x * m_clusters_y, false )
+   {
+      thread_pool.parallel_for( m_clump_labels.size(), [this]( Idx cluster ) {
+         label_cluster( cluster );
+      } );
+      thread_pool.parallel_for( m_clump_labels.size(), [this]( Idx cluster ) {
+         link_cluster( cluster );
+      } );
+      join_clusters();
+   }
+
+   // reassigns a pixel to another region
+   void set_label( V2u pos, Idx label ) {
+      if ( m_labels(pos) == label )
+         return;
+      m_labels(pos) = label;
+      Idx const cluster = cluster_of( pos );
+      if ( not m_is_dirty[cluster] ) {
+         m_is_dirty[cluster] = true;
+         m_dirty_clusters.push_back( cluster );
+      }
+      if ( not m_is_batching )
+         update();
+   }
+
+   void begin_batch() {
+      m_is_batching = true;
+   }
+
+   void end_batch() {
+      m_is_batching = false;
+      update();
+   }
+
+   Size component_count() const {
+      return m_component_labels.size();
+   }
+
+   // component id of a pixel, in [0, component_count())
+   Idx component_of( V2u pos ) const {
+      Idx cluster = cluster_of( pos );
+      return m_component_of_clump[ m_clump_offsets[cluster] + m_clump_of[ m_labels.index(pos) ] ];
+   }
+
+   Bool are_connected( V2u a, V2u b ) const {
+      return component_of(a) == component_of(b);
+   }
+
+   // the region label of a component
+   Idx label_of( Idx component ) const {
+      return m_component_labels[component];
+   }
+
+   // number of components of a region (0 if the label is unused)
+   Size component_count_of( Idx label ) const {
+      auto it = m_components_per_label.find( label );
+      return it == m_components_per_label.end()? 0 : it->second;
+   }
+
+   // labels of all regions that consist of more than one component, in ascending order
+   Vec<Idx> fragmented_regions() const {
+      Vec<Idx> labels;
+      for ( auto const &[label,count] : m_components_per_label )
+         if ( count > 1 )
+            labels.push_back( label );
+      std::sort( labels.begin(), labels.end() );
+      return labels;
+   }
+
+private:
+   struct ClumpLink { // a clump of a cluster and a clump of the same label in a neighbouring cluster
+      U16 clump,
+          neighbour_clump;
+
+      auto operator<=>( ClumpLink const & ) const = default;
+   };
+
+   Map<Idx>            &m_labels;
+   Size                 m_clusters_x,
+                        m_clusters_y;
+   Vec<U16>             m_clump_of;             // pixel -> clump index within its cluster
+   Vec<Vec<Idx>>        m_clump_labels;         // cluster -> region label of each of its clumps
+   Vec<Vec<ClumpLink>>  m_east_links,           // cluster -> links across its east border
+                        m_south_links;          // cluster -> links across its south border
+   Vec<Bool>            m_is_dirty;             // cluster -> needs relabelling
+   Vec<Idx>             m_dirty_clusters;
+   Vec<Idx>             m_relinked_clusters;    // scratch for update()
+   Bool                 m_is_batching = false;
+   Vec<Idx>             m_clump_offsets;        // cluster -> first global clump index
+   UnionFind            m_clumps;               // over global clump indices
+   Vec<Idx>             m_component_of_clump;   // global clump index -> component
+   Vec<Idx>             m_component_labels;     // component -> region label
+   HashMap<Idx,Size>    m_components_per_label;
+
+   Idx cluster_of( V2u pos ) const {
+      return (pos.y / cluster_side) * m_clusters_x + (pos.x / cluster_side);
+   }
+
+   // the neighbouring clusters, or invalid_idx at the map edge of non-tiled maps
+   Idx east_of( Idx cluster ) const {
+      Size const cx = cluster % m_clusters_x;
+      if ( cx + 1 < m_clusters_x )      return cluster + 1;
+      if constexpr ( T_is_tiled )       return cluster - cx;
+      return invalid_idx;
+   }
+
+   Idx west_of( Idx cluster ) const {
+      Size const cx = cluster % m_clusters_x;
+      if ( cx > 0 )                     return cluster - 1;
+      if constexpr ( T_is_tiled )       return cluster + m_clusters_x - 1;
+      return invalid_idx;
+   }
+
+   Idx south_of( Idx cluster ) const {
+      Size const cy = cluster / m_clusters_x;
+      if ( cy + 1 < m_clusters_y )      return cluster + m_clusters_x;
+      if constexpr ( T_is_tiled )       return cluster % m_clusters_x;
+      return invalid_idx;
+   }
+
+   Idx north_of( Idx cluster ) const {
+      Size const cy = cluster / m_clusters_x;
+      if ( cy > 0 )                     return cluster - m_clusters_x;
+      if constexpr ( T_is_tiled )       return cluster + (m_clusters_y - 1) * m_clusters_x;
+      return invalid_idx;
+   }
+
+   void update() {
+      if ( m_dirty_clusters.empty() )
+         return;
+      // a relabelled cluster invalidates its own links and those of its west and north neighbours
+      auto &relinked = m_relinked_clusters;
+      relinked.clear();
+      for ( auto cluster : m_dirty_clusters ) {
+         label_cluster( cluster );
+         m_is_dirty[cluster] = false;
+         for ( Idx neighbour : { cluster, west_of(cluster), north_of(cluster) } )
+            if ( neighbour != invalid_idx )
+               relinked.push_back( neighbour );
+      }
+      m_dirty_clusters.clear();
+      std::sort( relinked.begin(), relinked.end() );
+      relinked.erase( std::unique(relinked.begin(), relinked.end()), relinked.end() );
+      for ( auto cluster : relinked )
+         link_cluster( cluster );
+      join_clusters();
+   }
+
+   // labels the clumps of one cluster (ignoring everything outside of it)
+   void label_cluster( Idx cluster ) {
+      Size const  x_begin = (cluster % m_clusters_x) * cluster_side,
+                  y_begin = (cluster / m_clusters_x) * cluster_side,
+                  x_end   = std::min( x_begin + cluster_side, m_labels.width()  ),
+                  y_end   = std::min( y_begin + cluster_side, m_labels.height() ),
+                  side_x  = x_end - x_begin;
+
+      // local union-find over the cluster's pixels
+      Arr<U16, cluster_side * cluster_side> parent;
+      auto const find = [&parent]( U16 i ) {
+         while ( parent[i] != i )
+            i = parent[i] = parent[parent[i]];
+         return i;
+      };
+      auto const local = [&]( Size x, Size y ) {
+         return U16( (y - y_begin) * side_x + (x - x_begin) );
+      };
+      for ( Size y = y_begin;  y < y_end;  ++y ) {
+         for ( Size x = x_begin;  x < x_end;  ++x ) {
+            U16 const  i     = local( x, y );
+            Idx const  label = m_labels( x, y );
+            parent[i] = i;
+            if ( x > x_begin and m_labels(x-1, y) == label )
+               parent[i] = find( local(x-1, y) );
+            if ( y > y_begin and m_labels(x, y-1) == label ) {
+               U16 a = find( i ),
+                   b = find( local(x, y-1) );
+               if ( a != b )
+                  parent[std::max(a,b)] = std::min(a,b);
+            }
+         }
+      }
+      // compact the roots into clump indices
+      Arr<U16, cluster_side * cluster_side> clump_of_root;
+      auto &clump_labels = m_clump_labels[cluster];
+      clump_labels.clear();
+      for ( Size y = y_begin;  y < y_end;  ++y ) {
+         for ( Size x = x_begin;  x < x_end;  ++x ) {
+            U16 const i    = local( x, y ),
+                      root = find( i );
+            if ( root == i ) {
+               clump_of_root[i] = U16( clump_labels.size() );
+               clump_labels.push_back( m_labels(x,y) );
+            }
+            m_clump_of[ m_labels.index(x,y) ] = clump_of_root[root];
+         }
+      }
+   }
+
+   // links the clumps of a cluster to those of the same label across its east and south borders
+   // (including the wrapped map edges of tiled maps); needs both clusters to be labelled
+   void link_cluster( Idx cluster ) {
+      Size const  x_begin = (cluster % m_clusters_x) * cluster_side,
+                  y_begin = (cluster / m_clusters_x) * cluster_side,
+                  x_last  = std::min( x_begin + cluster_side, m_labels.width()  ) - 1,
+                  y_last  = std::min( y_begin + cluster_side, m_labels.height() ) - 1;
+      auto const  link = [this]( Vec<ClumpLink> &links, Size ax, Size ay, Size bx, Size by ) {
+         if ( m_labels(ax,ay) != m_labels(bx,by) )
+            return;
+         ClumpLink const l { m_clump_of[ m_labels.index(ax,ay) ], m_clump_of[ m_labels.index(bx,by) ] };
+         if ( links.empty() or links.back() != l ) // runs along the border repeat the same link
+            links.push_back( l );
+      };
+      auto const  deduplicate = []( Vec<ClumpLink> &links ) {
+         std::sort( links.begin(), links.end() );
+         links.erase( std::unique(links.begin(), links.end()), links.end() );
+      };
+
+      auto &east_links = m_east_links[cluster];
+      east_links.clear();
+      if ( east_of(cluster) != invalid_idx ) {
+         Size const east_x = (x_last + 1) % m_labels.width();
+         for ( Size y = y_begin;  y <= y_last;  ++y )
+            link( east_links, x_last, y, east_x, y );
+         deduplicate( east_links );
+      }
+      auto &south_links = m_south_links[cluster];
+      south_links.clear();
+      if ( south_of(cluster) != invalid_idx ) {
+         Size const south_y = (y_last + 1) % m_labels.height();
+         for ( Size x = x_begin;  x <= x_last;  ++x )
+            link( south_links, x, y_last, x, south_y );
+         deduplicate( south_links );
+      }
+   }
+
+   // joins clumps along the cluster links into global components
+   void join_clusters() {
+      Size const cluster_count = m_clump_labels.size();
+      m_clump_offsets.resize( cluster_count );
+      Size clump_total = 0;
+      for ( Idx cluster = 0;  cluster < cluster_count;  ++cluster ) {
+         m_clump_offsets[cluster] = clump_total;
+         clump_total += m_clump_labels[cluster].size();
+      }
+
+      m_clumps.reset( clump_total );
+      for ( Idx cluster = 0;  cluster < cluster_count;  ++cluster ) {
+         Idx const offset = m_clump_offsets[cluster];
+         for ( auto const &l : m_east_links[cluster] )
+            m_clumps.unite( offset + l.clump, m_clump_offsets[east_of(cluster)] + l.neighbour_clump );
+         for ( auto const &l : m_south_links[cluster] )
+            m_clumps.unite( offset + l.clump, m_clump_offsets[south_of(cluster)] + l.neighbour_clump );
+      }
+
+      // number the components in clump order, which keeps the ids deterministic
+      m_component_of_clump.assign( clump_total, invalid_idx );
+      m_component_labels.clear();
+      m_components_per_label.clear();
+      for ( Idx cluster = 0;  cluster < cluster_count;  ++cluster ) {
+         auto const &clump_labels = m_clump_labels[cluster];
+         for ( Idx clump = 0;  clump < clump_labels.size();  ++clump ) {
+            Idx const global = m_clump_offsets[cluster] + clump,
+                      root   = m_clumps.find( global );
+            if ( m_component_of_clump[root] == invalid_idx ) {
+               m_component_of_clump[root] = m_component_labels.size();
+               m_component_labels.push_back( clump_labels[clump] );
+               m_components_per_label[ clump_labels[clump] ]++;
+            }
+            m_component_of_clump[global] = m_component_of_clump[root];
+         }
+      }
+   }
+};
+
+// EOF
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "falk/defs.hpp"
+#include "falk/Parallel.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+struct RegionBounds { // inclusive pixel bounds
+   I32 min_x = std::numeric_limits<I32>::max(),
+       min_y = std::numeric_limits<I32>::max(),
+       max_x = std::numeric_limits<I32>::min(),
+       max_y = std::numeric_limits<I32>::min();
+};
+
+struct RegionBorder {
+   Idx   label_a;  // label_a < label_b
+   Idx   label_b;
+   Size  length;   // number of pixel edges shared by the two regions
+};
+
+// Per-label statistics of a label map. All arrays are indexed by label; labels
+// without any pixels have an area of 0 and meaningless centroids and bounds.
+// For tiled diagrams, coordinates are unwrapped around each label's Voronoi centre,
+// so centroids and bounds of regions crossing the map edge may lie outside the map.
+struct RegionStatistics {
+   Vec<Size>           areas;      // pixel count
+   Vec<V2f>            centroids;  // mean pixel position
+   Vec<RegionBounds>   bounds;
+   Vec<Size>           perimeters; // pixels with at least one 4-neighbour of another label
+   Vec<RegionBorder>   borders;    // sorted by (label_a, label_b)
+
+   Size label_count() const {
+      return areas.size();
+   }
+};
+
+// Computes area, centroid, bounds, perimeter and border lengths of every label in a single
+// pass. Rows are split into one stripe per thread. Each stripe accumulates only the labels it
+// contains and merges them into the result as soon as it is done, so the memory overhead does not
+// grow with label count times thread count. All sums are integral, so the result is independent
+// of thread count and merge order.
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionStatistics compute_region_statistics( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                                            Map<Idx> const                                    &map,
+                                            ThreadPool                                        &thread_pool = ThreadPool::shared() )
+{
+   struct LabelAccumulator {
+      Idx            label;
+      Size           area      = 0;
+      I64            sum_x     = 0,
+                     sum_y     = 0;
+      RegionBounds   bounds    = {};
+      Size           perimeter = 0;
+   };
+
+   Size const  label_count = voronoi_diagram.size();
+   I32 const   width       = static_cast<I32>( map.width()  ),
+               height      = static_cast<I32>( map.height() );
+   assert( label_count <= 0xFFFF'FFFFULL );
+   Idx const *const  cells = map.data();
+
+   // reference positions to unwrap tiled coordinates around: the Voronoi centre,
+   // or for labels without one, their first pixel in row-major order
+   Vec<V2f> references;
+   if constexpr ( T_is_tiled ) {
+      references.resize( label_count );
+      Vec<Size> first_pixels;
+      for ( Idx label = 0;  label < label_count;  ++label ) {
+         if ( voronoi_diagram.hasCentre(label) )
+            references[label] = voronoi_diagram.getCentre(label).pos;
+         else if ( first_pixels.empty() )
+            first_pixels.assign( label_count, std::numeric_limits<Size>::max() );
+      }
+      if ( not first_pixels.empty() ) {
+         thread_pool.parallel_for( map.height(), [&]( Idx y ) {
+            for ( Size i = y * width, end = i + width;  i < end;  ++i ) {
+               Idx const label = cells[i];
+               if ( voronoi_diagram.hasCentre(label) )
+                  continue;
+               std::atomic_ref<Size> first( first_pixels[label] );
+               for ( Size current = first.load();  i < current and not first.compare_exchange_weak(current, i); );
+            }
+         }, 16 );
+         for ( Idx label = 0;  label < label_count;  ++label )
+            if ( first_pixels[label] != std::numeric_limits<Size>::max() )
+               references[label] = V2f( F32(first_pixels[label] % width), F32(first_pixels[label] / width) );
+      }
+   }
+   auto const unwrap = [&]( I32 coordinate, F32 reference, I32 extent ) {
+      if constexpr ( T_is_tiled ) {
+         if ( coordinate - reference >  extent / 2 ) return coordinate - extent;
+         if ( reference - coordinate >  extent / 2 ) return coordinate + extent;
+      }
+      return coordinate;
+   };
+
+   RegionStatistics stats;
+   stats.areas.assign( label_count, 0 );
+   stats.centroids.assign( label_count, V2f(.0f, .0f) );
+   stats.bounds.assign( label_count, {} );
+   stats.perimeters.assign( label_count, 0 );
+   Vec<I64>           sums_x( label_count, 0 ),
+                      sums_y( label_count, 0 );
+   HashMap<U64,Size>  borders; // (label_a << 32 | label_b) -> length
+   std::mutex         merge_mutex;
+
+   Size const stripe_count = std::min<Size>( thread_pool.thread_count(), map.height() );
+   thread_pool.parallel_for( stripe_count, [&]( Idx stripe ) {
+      Vec<LabelAccumulator>  accumulators;
+      HashMap<Idx,Idx>       slot_of; // label -> index into accumulators
+      HashMap<U64,Size>      stripe_borders;
+      Idx                    last_label = invalid_idx,
+                             slot       = 0;
+
+      I32 const  y_begin = static_cast<I32>( height * stripe       / stripe_count ),
+                 y_end   = static_cast<I32>( height * (stripe + 1) / stripe_count );
+      for ( I32 y = y_begin;  y < y_end;  ++y ) {
+         for ( I32 x = 0;  x < width;  ++x ) {
+            Idx const label = cells[ Size(y) * width + x ];
+            if ( label != last_label ) { // labels come in runs along a row
+               auto [it, is_new] = slot_of.try_emplace( label, accumulators.size() );
+               if ( is_new )
+                  accumulators.push_back({ label });
+               slot       = it->second;
+               last_label = label;
+            }
+            auto &acc = accumulators[slot];
+            I32 ux = x,
+                uy = y;
+            if constexpr ( T_is_tiled ) {
+               ux = unwrap( x, references[label].x, width  );
+               uy = unwrap( y, references[label].y, height );
+            }
+            acc.area++;
+            acc.sum_x += ux;
+            acc.sum_y += uy;
+            auto &b = acc.bounds;
+            b.min_x = std::min( b.min_x, ux );  b.max_x = std::max( b.max_x, ux );
+            b.min_y = std::min( b.min_y, uy );  b.max_y = std::max( b.max_y, uy );
+
+            // 4-neighbours; east and south edges are also counted as borders (each edge once)
+            Bool is_on_perimeter = false;
+            auto const visit = [&]( I32 nx, I32 ny, Bool is_counted_edge ) {
+               if constexpr ( T_is_tiled ) {
+                  nx = (nx + width)  % width;
+                  ny = (ny + height) % height;
+               }
+               else if ( nx < 0 or ny < 0 or nx >= width or ny >= height ) {
+                  is_on_perimeter = true; // the map edge
+                  return;
+               }
+               Idx const neighbour = cells[ Size(ny) * width + nx ];
+               if ( neighbour == label )
+                  return;
+               is_on_perimeter = true;
+               if ( is_counted_edge ) {
+                  U64 const key = label < neighbour?  (U64(label) << 32) | neighbour
+                                                   :  (U64(neighbour) << 32) | label;
+                  stripe_borders[key]++;
+               }
+            };
+            visit( x+1, y,   true  );
+            visit( x,   y+1, true  );
+            visit( x-1, y,   false );
+            visit( x,   y-1, false );
+            if ( is_on_perimeter )
+               acc.perimeter++;
+         }
+      }
+
+      // merge:
+      std::lock_guard lock( merge_mutex );
+      for ( auto const &acc : accumulators ) {
+         stats.areas[acc.label]      += acc.area;
+         stats.perimeters[acc.label] += acc.perimeter;
+         sums_x[acc.label]           += acc.sum_x;
+         sums_y[acc.label]           += acc.sum_y;
+         auto &b = stats.bounds[acc.label];
+         auto &a = acc.bounds;
+         b.min_x = std::min( b.min_x, a.min_x );  b.max_x = std::max( b.max_x, a.max_x );
+         b.min_y = std::min( b.min_y, a.min_y );  b.max_y = std::max( b.max_y, a.max_y );
+      }
+      for ( auto const &[key,length] : stripe_borders )
+         borders[key] += length;
+   } );
+
+   for ( Idx label = 0;  label < label_count;  ++label )
+      if ( Size area = stats.areas[label] )
+         stats.centroids[label] = V2f( F64(sums_x[label]) / area,
+                                       F64(sums_y[label]) / area );
+
+   stats.borders.reserve( borders.size() );
+   for ( auto const &[key,length] : borders )
+      stats.borders.push_back({ Idx(key >> 32), Idx(key & 0xFFFF'FFFFULL), length });
+   std::sort( stats.borders.begin(), stats.borders.end(),
+              []( RegionBorder const &lhs, RegionBorder const &rhs ) {
+                 return lhs.label_a != rhs.label_a?  lhs.label_a < rhs.label_a  :  lhs.label_b < rhs.label_b;
+              } );
+   return stats;
+}
+
+// Moves every Voronoi centre to the centroid of its region and removes the centres of cells
+// that were assimilated by other regions, so that the diagram's cells become the regions.
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+void move_centres_to_centroids( Voronoi<T_is_tiled, T_threshold_percentage> &voronoi_diagram,
+                                RegionStatistics const                      &stats )
+{
+   V2f const dim = voronoi_diagram.dimensions();
+   voronoi_diagram.relocateCentres( [&]( auto const &centre ) -> Opt<V2f> {
+      if ( centre.index >= stats.label_count() or stats.areas[centre.index] == 0 )
+         return {};
+      V2f pos = stats.centroids[centre.index];
+      if constexpr ( T_is_tiled ) { // wrap unwrapped centroids back into the map
+         pos.x -= std::floor( pos.x / dim.x ) * dim.x;
+         pos.y -= std::floor( pos.y / dim.y ) * dim.y;
+      }
+      return pos;
+   } );
+}
+
+// EOF
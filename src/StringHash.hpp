@@ -0,0 +1,83 @@
+#pragma once
+
+// Only std types here: falk.hpp includes this header to build falk::hash and ""_h on it.
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+// wyhash-style string hash: 16 bytes per step, each folded in with a 64x64->128 bit multiply.
+// The same code runs at compile time and at run time, so constant and runtime hashes always
+// match; only the loads differ (byte by byte while constant evaluated, one unaligned load otherwise).
+namespace string_hash_detail {
+   using Word = std::uint64_t;
+
+   Word constexpr secret[3] { 0xA076'1D64'78BD'642Full, 0xE703'7ED1'A0B4'28DBull, 0x8EBC'6AF0'9C88'C6E3ull };
+
+   // the xor of the two halves of the 128-bit product
+   constexpr inline Word mix( Word a, Word b ) noexcept {
+   #ifdef __SIZEOF_INT128__
+      __uint128_t const product = __uint128_t( a ) * b;
+      return Word( product ) ^ Word( product >> 64 );
+   #else
+      Word const a_lo = a & 0xFFFF'FFFF,  a_hi = a >> 32,
+                 b_lo = b & 0xFFFF'FFFF,  b_hi = b >> 32,
+                 lo_lo = a_lo * b_lo,  hi_lo = a_hi * b_lo,
+                 lo_hi = a_lo * b_hi,  hi_hi = a_hi * b_hi,
+                 cross = (lo_lo >> 32) + (hi_lo & 0xFFFF'FFFF) + lo_hi;
+      return ( (cross << 32) | (lo_lo & 0xFFFF'FFFF) ) ^ ( hi_hi + (hi_lo >> 32) + (cross >> 32) );
+   #endif
+   }
+
+   // `count` (<= 8) bytes as a little-endian word
+   constexpr inline Word load( char const *bytes, std::size_t count ) noexcept {
+      if ( std::is_constant_evaluated() or count < 8 or std::endian::native != std::endian::little ) {
+         Word word = 0;
+         for ( std::size_t i = 0;  i < count;  ++i )
+            word |= Word( static_cast<unsigned char>(bytes[i]) ) << (8 * i);
+         return word;
+      }
+      Word word;
+      std::memcpy( &word, bytes, sizeof word );
+      return word;
+   }
+}
+
+constexpr inline std::uint64_t string_hash( std::string_view s ) noexcept {
+   using namespace string_hash_detail;
+   char const   *bytes     = s.data();
+   std::size_t   remaining = s.size();
+   Word          state     = secret[0] ^ mix( s.size() ^ secret[1], secret[2] );
+   for ( ;  remaining > 16;  bytes += 16, remaining -= 16 )
+      state = mix( load(bytes, 8) ^ secret[1], load(bytes + 8, 8) ^ state );
+   Word const a = load( bytes, std::min<std::size_t>(remaining, 8) ),
+              b = remaining > 8? load( bytes + 8, remaining - 8 ) : 0;
+   return mix( secret[1] ^ s.size(), mix(a ^ secret[1], b ^ state) );
+}
+
+// Transparent hasher: the StrHashMap and StrHashSet below (which use it) can be searched
+// with a char const* or std::string_view without building a string.
+struct StringHash {
+   using is_transparent = void;
+   std::size_t operator()( std::string_view s ) const noexcept {
+      return static_cast<std::size_t>( string_hash(s) );
+   }
+};
+
+template <class V> using StrHashMap = std::unordered_map<std::string,V,StringHash,std::equal_to<>>;
+using                    StrHashSet = std::unordered_set<std::string,StringHash,std::equal_to<>>;
+
+// The constant-evaluated hashes of one key per tail length class (empty, < 8, 8..16 and several
+// 16-byte steps), pinned to what the runtime word loads produce for the same keys.
+static_assert( string_hash("")                              == 0x7A96'15F2'B0A2'31F5ull );
+static_assert( string_hash("falk")                          == 0x777A'10AB'7F48'8B62ull );
+static_assert( string_hash("region_1478")                   == 0xC7F6'9FC2'D4D5'9BEEull );
+static_assert( string_hash("assets/maps/region_1478.dvmap")  == 0xF999'B6B9'2E46'3D1Full );
+
+// EOF
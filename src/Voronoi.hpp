@@ -2,36 +2,50 @@
 
 #include "falk/defs.hpp"
 #include "falk/RNG.hpp"
+#include "falk/CounterRNG.hpp"
+#include "falk/Parallel.hpp"
+#include "falk/PngWriter.hpp"
+#include "falk/PngReader.hpp"
+#include "falk/Profiler.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <concepts>
 #include <cstdio>
 #include <cmath>
 #include <limits>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 #define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../../stb_image.h"
-#include "../../stb_image_write.h"
 
 template <class T>
 class RandomAccessHashSet {
 public:
    void insert( T const &e ) {
-      if ( not m_set.contains(e) ) {
+      if ( not m_indices.contains(e) ) {
+         m_indices[e] = m_vec.size();
          m_vec.push_back(e);
-         m_set.insert(e);
       }
    }
    
+   // O(1): swaps the last element into the removed element's slot
    void remove( T const &e ) {
-      if ( m_set.contains(e) ) {
-         m_set.erase(e);
-         m_vec.erase( std::remove(m_vec.begin(), m_vec.end(), e), m_vec.end() );
+      if ( auto it = m_indices.find(e);  it != m_indices.end() ) {
+         Idx index = it->second;
+         m_indices.erase( it );
+         if ( index != m_vec.size() - 1 ) {
+            m_vec[index]            = std::move( m_vec.back() );
+            m_indices[m_vec[index]] = index;
+         }
+         m_vec.pop_back();
       }
    }
 
    Bool contains( T const &e ) const {
-      return m_set.contains(e);
+      return m_indices.contains(e);
    }
 
    Bool empty() const {
@@ -58,9 +72,185 @@ public:
       return m_vec.end();
    }
 
+   auto begin() const {
+      return m_vec.begin();
+   }
+   
+   auto end() const {
+      return m_vec.end();
+   }
+
+private:
+   HashMap<T,Idx>  m_indices; // element -> index in m_vec
+   Vec<T>          m_vec;
+};
+
+// Disjoint sets over dense indices that also track the lowest index of each set.
+class UnionFind {
+public:
+   UnionFind( Size size=0 ) {
+      reset( size );
+   }
+
+   // makes every index its own set again (keeps the allocated capacity)
+   void reset( Size size ) {
+      m_parent.resize( size );
+      m_lowest.resize( size );
+      for ( Idx index = 0;  index < size;  ++index )
+         m_parent[index] = m_lowest[index] = index;
+   }
+
+   Idx find( Idx index ) {
+      while ( m_parent[index] != index ) {
+         m_parent[index] = m_parent[m_parent[index]]; // path halving
+         index           = m_parent[index];
+      }
+      return index;
+   }
+
+   // merges the set of `index` into the set of `into`; returns the new root
+   Idx unite( Idx into, Idx index ) {
+      Idx root  = find( into ),
+          other = find( index );
+      if ( root != other ) {
+         m_parent[other] = root;
+         m_lowest[root]  = std::min( m_lowest[root], m_lowest[other] );
+      }
+      return root;
+   }
+
+   Idx lowest( Idx index ) {
+      return m_lowest[ find(index) ];
+   }
+
+   Size size() const {
+      return m_parent.size();
+   }
+
 private:
-   HashSet<T>  m_set;
-   Vec<T>      m_vec;
+   Vec<Idx>  m_parent;
+   Vec<Idx>  m_lowest; // only valid for roots
+};
+
+// Binary max-heap over dense keys [0,capacity) with O(log n) priority updates.
+// Ties are broken by the lower key, so the pop order is fully deterministic.
+template <typename T_Priority = F32>
+class IndexedHeap {
+public:
+   IndexedHeap( Size capacity=0 ) {
+      reset( capacity );
+   }
+
+   // empties the heap (keeps the allocated capacity)
+   void reset( Size capacity ) {
+      m_heap.clear();
+      m_position.assign( capacity, invalid_idx );
+      m_priority.resize( capacity );
+   }
+
+   Bool empty() const {
+      return m_heap.empty();
+   }
+
+   Size size() const {
+      return m_heap.size();
+   }
+
+   Bool contains( Idx key ) const {
+      return m_position[key] != invalid_idx;
+   }
+
+   Idx top() const {
+      assert( not empty() );
+      return m_heap.front();
+   }
+
+   T_Priority priority( Idx key ) const {
+      return m_priority[key];
+   }
+
+   // inserts the key, or updates its priority if it is already in the heap
+   void push( Idx key, T_Priority priority ) {
+      if ( contains(key) )
+         return update( key, priority );
+      m_priority[key] = priority;
+      m_position[key] = m_heap.size();
+      m_heap.push_back( key );
+      sift_up( m_position[key] );
+   }
+
+   void update( Idx key, T_Priority priority ) {
+      assert( contains(key) );
+      T_Priority const old_priority = m_priority[key];
+      m_priority[key] = priority;
+      if ( old_priority < priority )
+         sift_up( m_position[key] );
+      else
+         sift_down( m_position[key] );
+   }
+
+   void pop() {
+      erase( top() );
+   }
+
+   void erase( Idx key ) {
+      assert( contains(key) );
+      Idx position = m_position[key];
+      m_position[key] = invalid_idx;
+      if ( position == m_heap.size() - 1 ) {
+         m_heap.pop_back();
+         return;
+      }
+      Idx moved_key = m_heap.back();
+      m_heap.pop_back();
+      move_to( moved_key, position );
+      sift_up( position );
+      sift_down( m_position[moved_key] );
+   }
+
+private:
+   Vec<Idx>         m_heap;     // keys in heap order
+   Vec<Idx>         m_position; // key -> position in m_heap, invalid_idx if absent
+   Vec<T_Priority>  m_priority; // key -> priority
+
+   Bool is_before( Idx key_a, Idx key_b ) const {
+      return m_priority[key_a] > m_priority[key_b]
+          or ( m_priority[key_a] == m_priority[key_b] and key_a < key_b );
+   }
+
+   void move_to( Idx key, Idx position ) {
+      m_heap[position] = key;
+      m_position[key]  = position;
+   }
+
+   void sift_up( Idx position ) {
+      Idx key = m_heap[position];
+      while ( position > 0 ) {
+         Idx parent = (position - 1) / 2;
+         if ( not is_before(key, m_heap[parent]) )
+            break;
+         move_to( m_heap[parent], position );
+         position = parent;
+      }
+      move_to( key, position );
+   }
+
+   void sift_down( Idx position ) {
+      Idx const  key   = m_heap[position];
+      Size const count = m_heap.size();
+      for (;;) {
+         Idx child = 2 * position + 1;
+         if ( child >= count )
+            break;
+         if ( child + 1 < count and is_before(m_heap[child+1], m_heap[child]) )
+            ++child;
+         if ( not is_before(m_heap[child], key) )
+            break;
+         move_to( m_heap[child], position );
+         position = child;
+      }
+      move_to( key, position );
+   }
 };
 
 namespace Direction {
@@ -255,6 +445,18 @@ struct Map {
    inline V2u dimensions() const {
       return m_dim;
    }
+
+   inline Size size() const {
+      return m_map.size();
+   }
+
+   inline T* data() {
+      return m_map.data();
+   }
+
+   inline T const* data() const {
+      return m_map.data();
+   }
    
    inline Size index( V2u pos ) const {
       return index( pos.x, pos.y );
@@ -264,11 +466,75 @@ struct Map {
       return y * m_dim.x + x;
    }
 
+   // changes the dimensions and resets every element, reusing the storage where possible
+   void resize( V2u dim, T default_value = T() ) {
+      m_map.assign( Size(dim.x) * dim.y, default_value );
+      m_dim = dim;
+   }
+
 private:
    Vec<T>  m_map; // map data
    V2u     m_dim; // map dimensions
 };
 
+// Non-owning, read-only view of row-major map data (e.g. a memory-mapped file).
+template <typename T>
+class MapView {
+public:
+   MapView( T const *data, V2u dim ):
+      m_data ( data ),
+      m_dim  ( dim )
+   {}
+
+   MapView( Map<T> const &map ):
+      m_data ( map.data() ),
+      m_dim  ( map.dimensions() )
+   {}
+
+   T const& operator()( Size x, Size y ) const {
+      assert( (x < m_dim.x) and (y < m_dim.y) );
+      return m_data[ index(x,y) ];
+   }
+
+   T const& operator()( V2u pos ) const {
+      return (*this)( pos.x, pos.y );
+   }
+
+   inline Size width() const {
+      return m_dim.x;
+   }
+
+   inline Size height() const {
+      return m_dim.y;
+   }
+
+   inline V2u dimensions() const {
+      return m_dim;
+   }
+
+   inline Size size() const {
+      return Size(m_dim.x) * m_dim.y;
+   }
+
+   inline T const* data() const {
+      return m_data;
+   }
+
+   inline Size index( Size x, Size y ) const {
+      return y * m_dim.x + x;
+   }
+
+   Map<T> to_map() const {
+      Map<T> map { m_dim };
+      std::copy( m_data, m_data + size(), map.data() );
+      return map;
+   }
+
+private:
+   T const *m_data; // not owned
+   V2u      m_dim;
+};
+
 // TODO: DistanceFunction Concept
 enum class DistanceFunction { manhattan, euclidean, chebychev, weirdness };
 
@@ -314,44 +580,148 @@ struct Voronoi {
 
    void addCentre( V2f pos, F32 weight=1.0f ) {
       assert( pos.x <= m_dim.x and pos.y <= m_dim.y );
+      m_centre_slots.push_back( m_centres.size() );
       m_centres.push_back( Centre{ pos, weight, m_next_idx++ } );
       if constexpr ( T_is_tiled )
          tileCopyCentre( m_centres.back() );
    }
 
+   // adds a whole point set (e.g. from poisson_disk_sample) with a common weight
+   void addCentres( std::span<V2f const> positions, F32 weight=1.0f ) {
+      m_centres.reserve( m_centres.size() + positions.size() );
+      m_centre_slots.reserve( m_centre_slots.size() + positions.size() );
+      for ( auto pos : positions )
+         addCentre( pos, weight );
+   }
+
    Size size() const {
       return m_next_idx;
    }
 
+   // removes all centres (keeping the allocated storage) so the diagram can be reused
+   void reset( V2f dimensions ) {
+      m_next_idx = 0;
+      m_dim      = dimensions;
+      m_centres.clear();
+      m_centre_slots.clear();
+   }
+
+   // the original (non tile-copied) centre of cell `index`
+   Centre const& getCentre( Idx index ) const {
+      assert( hasCentre(index) );
+      return m_centres[ m_centre_slots[index] ];
+   }
+
+   Bool hasCentre( Idx index ) const {
+      return index < m_centre_slots.size() and m_centre_slots[index] != invalid_idx;
+   }
+
+   // Moves every centre to new_position_of(centre); centres it returns no position for are
+   // removed. Cell indices are kept, so a removed index is never reused.
+   template <typename T_NewPosition>
+   void relocateCentres( T_NewPosition &&new_position_of ) {
+      DV_PROFILE_ZONE( "Voronoi::relocateCentres" );
+      Vec<Centre> old_centres;
+      old_centres.swap( m_centres );
+      for ( auto &slot : m_centre_slots ) {
+         if ( slot == invalid_idx )
+            continue;
+         Centre     centre          = old_centres[slot];
+         Opt<V2f>   maybe_position  = new_position_of( std::as_const(centre) );
+         if ( not maybe_position ) {
+            slot = invalid_idx;
+            continue;
+         }
+         centre.pos = maybe_position.value();
+         assert( centre.pos.x <= m_dim.x and centre.pos.y <= m_dim.y );
+         slot = m_centres.size();
+         m_centres.push_back( centre );
+         if constexpr ( T_is_tiled )
+            tileCopyCentre( m_centres.back() );
+      }
+   }
+
+   V2f dimensions() const {
+      return m_dim;
+   }
+
    // NOTE: Unoptimized! TODO
    template <typename T_DistanceFunction = EuclideanDistance>
    Map<Idx> toMap( V2u dimensions, V2f offset={.0f,.0f} ) const {
-      T_DistanceFunction distance_between;
       Map<Idx> map { dimensions };
-      for ( auto point : map.in_context() ) {
-         F32  shortestDistance = std::numeric_limits<F32>::max();
-         Size closestCentreIdx = -1;
-         for ( auto const &centre : m_centres ) {
-            F32 distance = distance_between( offset+point.pos, centre.pos ) * (1.0f / centre.weight);
-            if ( distance < shortestDistance ) {
-               shortestDistance = distance;
-               closestCentreIdx = centre.index;
+      toMap<T_DistanceFunction>( map, offset );
+      return map;
+   }
+
+   // as above, but into an existing map (of any dimensions) to reuse its storage
+   template <typename T_DistanceFunction = EuclideanDistance>
+   void toMap( Map<Idx> &map, V2f offset={.0f,.0f} ) const {
+      DV_PROFILE_ZONE( "Voronoi::toMap" );
+      for ( auto point : map.in_context() )
+         point.value = findClosestCentre<T_DistanceFunction>( offset+point.pos );
+   }
+
+   // The step of the first toMapProgressive pass (1/16 of the resolution per axis).
+   static constexpr Size progressive_coarsest_step = 16;
+
+   // Progressive toMap for previews. Passes at steps 16, 8, 4, 2 and 1 each compute only the
+   // pixels whose coordinates are multiples of the step but not both multiples of twice the
+   // step, so each pass refines the samples of the coarser ones, and every pixel is computed
+   // exactly once: the total work equals toMap (the rows of a pass run in parallel). After each
+   // pass, every sample also fills the step x step block it anchors, so the map is complete and
+   // on_pass(map, step) can show it; the final pass leaves exactly the result of toMap.
+   // on_pass returns false to stop early, in which case this returns false.
+   template <typename T_DistanceFunction = EuclideanDistance, typename T_OnPass>
+   Bool toMapProgressive( Map<Idx> &map, T_OnPass &&on_pass, ThreadPool &thread_pool = ThreadPool::shared(),
+                          V2f offset={.0f,.0f} ) const {
+      DV_PROFILE_ZONE( "Voronoi::toMapProgressive" );
+      Size const width  = map.width(),
+                 height = map.height();
+      for ( Size step = progressive_coarsest_step;  step >= 1;  step /= 2 ) {
+         Bool const is_coarsest = step == progressive_coarsest_step;
+         thread_pool.parallel_for( (height + step - 1) / step, [&]( Idx row ) {
+            Size const y          = row * step,
+                       block_rows = std::min( step, height - y );
+            Bool const is_new_row = is_coarsest or row % 2; // otherwise only the odd columns are new
+            for ( Size x = is_new_row? 0 : step;  x < width;  x += is_new_row? step : 2*step ) {
+               Idx const  label         = findClosestCentre<T_DistanceFunction>( offset+V2u(x, y) );
+               Size const block_columns = std::min( step, width - x );
+               for ( Size block_y = y;  block_y < y + block_rows;  ++block_y )
+                  std::fill_n( &map(x, block_y), block_columns, label );
             }
-         }
-         point.value = closestCentreIdx;
+         } );
+         if ( not on_pass(std::as_const(map), step) )
+            return false;
       }
-      return map;
+      return true;
    }
 
 private:
    Size         m_next_idx = 0;
    V2f          m_dim;
    Vec<Centre>  m_centres;
+   Vec<Idx>     m_centre_slots; // cell index -> index of its original centre in m_centres
+
+   // the index of the cell whose (weighted) centre is nearest to pos
+   template <typename T_DistanceFunction>
+   Idx findClosestCentre( V2f pos ) const {
+      T_DistanceFunction distance_between;
+      F32  shortestDistance = std::numeric_limits<F32>::max();
+      Size closestCentreIdx = -1;
+      for ( auto const &centre : m_centres ) {
+         F32 distance = distance_between( pos, centre.pos ) * (1.0f / centre.weight);
+         if ( distance < shortestDistance ) {
+            shortestDistance = distance;
+            closestCentreIdx = centre.index;
+         }
+      }
+      return closestCentreIdx;
+   }
 
-   void tileCopyCentre( Centre const &c ) {
+   void tileCopyCentre( Centre const c ) { // by value: the pushes below may reallocate m_centres
       static constexpr F32 threshold = .01f * T_threshold_percentage;
 
-      static F32 const  x_lower_threshold =         threshold  * m_dim.x,
+      F32 const         x_lower_threshold =         threshold  * m_dim.x,
                         x_upper_threshold = (1.0f - threshold) * m_dim.x,
                         y_lower_threshold =         threshold  * m_dim.y,
                         y_upper_threshold = (1.0f - threshold) * m_dim.y;
@@ -374,6 +744,7 @@ private:
 
 using CellNeighbourMap = HashMap<Idx,RandomAccessHashSet<Idx>>;
 CellNeighbourMap  generate_neighbour_map( Map<Idx> const &map ) {
+   DV_PROFILE_ZONE( "generate_neighbour_map" );
    CellNeighbourMap  neighbour_map;
    for ( auto const &e : map.in_context() )
       for ( auto const &neighbour : map.get_neighbours(e.pos) )
@@ -382,136 +753,723 @@ CellNeighbourMap  generate_neighbour_map( Map<Idx> const &map ) {
    return neighbour_map;
 }
 
-void map2png( Map<Idx> const &map, Str path ) {
-   Size const TEX_WIDTH  { map.width()  },
-              TEX_HEIGHT { map.height() };
-   Vec<RGBA>  pixels( TEX_WIDTH * TEX_HEIGHT );
+// Dense (CSR) cell adjacency: the neighbours of cell i are
+// neighbours[offsets[i]] up to (but excluding) neighbours[offsets[i+1]].
+struct CellAdjacency {
+   Vec<Idx>       offsets;
+   Vec<Idx>       neighbours;
+   Vec<Vec<Idx>>  scratch; // per-cell build buffers, kept around for reuse
+
+   void build( Map<Idx> const &map, Size cell_count ) {
+      DV_PROFILE_ZONE( "CellAdjacency::build" );
+      scratch.resize( cell_count );
+      for ( auto &cell_neighbours : scratch )
+         cell_neighbours.clear();
+      for ( auto const &e : map.in_context() ) {
+         auto &cell_neighbours = scratch[e.value];
+         for ( auto const &neighbour : map.get_neighbours(e.pos) )
+            if ( neighbour != e.value and std::find(cell_neighbours.begin(), cell_neighbours.end(), neighbour) == cell_neighbours.end() )
+               cell_neighbours.push_back( neighbour );
+      }
+      offsets.resize( cell_count + 1 );
+      neighbours.clear();
+      for ( Idx cell = 0;  cell < cell_count;  ++cell ) {
+         offsets[cell] = neighbours.size();
+         neighbours.insert( neighbours.end(), scratch[cell].begin(), scratch[cell].end() );
+      }
+      offsets[cell_count] = neighbours.size();
+   }
+
+   std::span<Idx const> operator[]( Idx cell ) const {
+      return { neighbours.data() + offsets[cell], neighbours.data() + offsets[cell+1] };
+   }
+};
+
+// A distinct, opaque colour per index: Fibonacci hashing spreads consecutive indices over the
+// whole RGB cube, so neighbouring labels (which tend to have close indices) stay distinguishable.
+// Packed like an RGBA pixel in memory: R in the low byte, A in the high byte.
+inline RGBA index_colour( Idx index ) {
+   return 0xFF'000000u | ( (U32(index) * 0x9E37'79B1u) >> 8 );
+}
+
+// colourizes a row of labels (a multiply and a shift per pixel, which the compiler vectorizes;
+// no table, so any label value works, including invalid_idx)
+template <typename T_Index>
+inline void apply_index_colours( T_Index const *__restrict labels, RGBA *__restrict colours, Size count ) {
+   for ( Size i = 0;  i < count;  ++i )
+      colours[i] = index_colour( static_cast<Idx>(labels[i]) );
+}
+
+// NOTE: rows are converted on the fly and compressed in parallel stripes;
+//       peak memory is independent of the map height
+Bool map2png( Map<Idx> const &map, Str path, I32 compression_level=Z_DEFAULT_COMPRESSION, ThreadPool &thread_pool=ThreadPool::shared() ) {
+   DV_PROFILE_ZONE( "map2png" );
+   PngWriter png( path, map.width(), map.height(), PngWriter::ColourType::rgba, 8, compression_level );
+   return png.write_rows_parallel( [&]( Size y, Byte *row_bytes ) {
+      apply_index_colours( &map(0,y), reinterpret_cast<RGBA*>(row_bytes), map.width() );
+   }, thread_pool );
+}
 
-   for ( auto e: map.in_context() )
-      pixels[ map.index(e.pos) ] = 0xFF'000000 + (((U32)std::pow(e.value, 2)) & 0x00'FFFFFFu);
-   
-   stbi_write_png( path.c_str(), static_cast<I32>(TEX_WIDTH), static_cast<I32>(TEX_HEIGHT), 4, pixels.data(), TEX_WIDTH * 4 );
+// colours every cell by its number of neighbours
+Bool neighbours_map2png( Map<Size> const &map, CellNeighbourMap const &neighbours_map, Str path, I32 compression_level=Z_DEFAULT_COMPRESSION, ThreadPool &thread_pool=ThreadPool::shared() ) {
+   DV_PROFILE_ZONE( "neighbours_map2png" );
+   PngWriter png( path, map.width(), map.height(), PngWriter::ColourType::rgba, 8, compression_level );
+   return png.write_rows_parallel( [&]( Size y, Byte *row_bytes ) {
+      RGBA *colours     = reinterpret_cast<RGBA*>( row_bytes );
+      Size  cached_cell = invalid_idx;
+      RGBA  colour      = 0;
+      for ( Size x = 0;  x < map.width();  ++x ) { // cells come in runs; look each run up once
+         if ( Size cell = map(x,y);  cell != cached_cell ) {
+            auto const it = neighbours_map.find( cached_cell = cell );
+            colour = index_colour( it == neighbours_map.end()?  0  :  it->second.size() );
+         }
+         colours[x] = colour;
+      }
+   }, thread_pool );
 }
 
-void neighbours_map2png( Map<Size> const &map, CellNeighbourMap const &neighbours_map, Str path ) {
-   Size const TEX_WIDTH  { map.width()  },
-              TEX_HEIGHT { map.height() };
-   Vec<RGBA>  pixels( TEX_WIDTH * TEX_HEIGHT );
+// Lossless label map export. The format depends on the number of distinct labels:
+//   <= 256    8-bit palette PNG; the palette index -> label table goes in a "dvLb" chunk
+//   <= 65536  16-bit greyscale PNG; either the labels themselves (if all are < 65536)
+//             or indices into the "dvLb" table
+//   else      8-bit RGBA PNG holding the label's 32 bits (R = most significant byte)
+// The "dvLb" chunk holds big-endian U32 labels. png2label_map loads any of them back.
+// Empty maps fail (PNG has no empty images, and a palette needs at least one entry).
+Bool label_map2png( Map<Idx> const &map, Str path, I32 compression_level=Z_DEFAULT_COMPRESSION, ThreadPool &thread_pool=ThreadPool::shared() ) {
+   DV_PROFILE_ZONE( "label_map2png" );
+   if ( map.size() == 0 )
+      return false;
+   // collect the distinct labels (runs of equal labels only get looked up once)
+   HashSet<Idx> label_set;
+   Idx previous = invalid_idx;
+   for ( Size i = 0, n = map.size();  i < n;  ++i )
+      if ( Idx label = map.data()[i];  label != previous )
+         label_set.insert( previous = label );
+   Vec<Idx> labels( label_set.begin(), label_set.end() );
+   std::sort( labels.begin(), labels.end() );
+   assert( labels.empty() or labels.back() <= 0xFFFF'FFFFULL );
+
+   Bool const is_palette  = labels.size() <= 256,
+              is_grey16   = not is_palette and labels.size() <= 65536,
+              needs_table = is_palette or ( is_grey16 and labels.back() > 0xFFFF );
+
+   // label -> stored value
+   HashMap<Idx,U32> value_of;
+   for ( Idx i = 0;  i < labels.size();  ++i )
+      value_of[labels[i]] = needs_table? U32(i) : U32(labels[i]);
+
+   auto const colour_type = is_palette? PngWriter::ColourType::palette
+                          : is_grey16?  PngWriter::ColourType::grey
+                          :             PngWriter::ColourType::rgba;
+   PngWriter png( path, map.width(), map.height(), colour_type, is_grey16? 16 : 8, compression_level );
+   if ( is_palette ) {
+      Vec<RGBA> colours( labels.size() ); // the colours map2png gives these labels
+      for ( Idx i = 0;  i < labels.size();  ++i )
+         colours[i] = index_colour( labels[i] );
+      png.write_palette( colours );
+   }
+   if ( needs_table ) {
+      Vec<Byte> table( labels.size() * 4 );
+      for ( Idx i = 0;  i < labels.size();  ++i )
+         for ( Idx b = 0;  b < 4;  ++b )
+            table[i*4+b] = static_cast<Byte>( labels[i] >> (24 - 8*b) );
+      png.write_ancillary_chunk( "dvLb", table );
+   }
 
-   for ( auto e: map.in_context() )
-      pixels[ map.index(e.pos) ] = 0xFF'000000 + (((U32)std::pow(neighbours_map.at(e.value).size(), 13)) & 0x00'FFFFFFu);
-   
-   stbi_write_png( path.c_str(), static_cast<I32>(TEX_WIDTH), static_cast<I32>(TEX_HEIGHT), 4, pixels.data(), TEX_WIDTH * 4 );
-   
+   return png.write_rows_parallel( [&]( Size y, Byte *row ) {
+      Idx cached_label = invalid_idx;
+      U32 value        = 0;
+      for ( Size x = 0;  x < map.width();  ++x ) {
+         if ( Idx label = map(x,y);  label != cached_label )
+            value = value_of.at( cached_label = label );
+         if ( is_palette )
+            row[x] = static_cast<Byte>( value );
+         else if ( is_grey16 ) {
+            row[x*2+0] = static_cast<Byte>( value >> 8 );
+            row[x*2+1] = static_cast<Byte>( value      );
+         }
+         else for ( Idx b = 0;  b < 4;  ++b )
+            row[x*4+b] = static_cast<Byte>( value >> (24 - 8*b) );
+      }
+   }, thread_pool );
 }
 
+// loads a label map written by label_map2png; empty if the file is missing, corrupt or of another format
+Opt<Map<Idx>> png2label_map( Str path ) {
+   DV_PROFILE_ZONE( "png2label_map" );
+   PngReader png( path );
+   using ColourType = PngReader::ColourType;
+   Bool const is_palette = png.colour_type() == ColourType::palette and png.bit_depth() == 8,
+              is_grey16  = png.colour_type() == ColourType::grey    and png.bit_depth() == 16,
+              is_rgba    = png.colour_type() == ColourType::rgba    and png.bit_depth() == 8;
+   if ( not png.is_ok() or not (is_palette or is_grey16 or is_rgba) )
+      return {};
+
+   Vec<Idx> table;
+   if ( auto maybe_chunk = png.ancillary_chunk("dvLb") ) {
+      auto const &chunk = maybe_chunk.value();
+      for ( Size i = 0;  i + 3 < chunk.size();  i += 4 )
+         table.push_back( (Idx(chunk[i]) << 24) | (Idx(chunk[i+1]) << 16) | (Idx(chunk[i+2]) << 8) | Idx(chunk[i+3]) );
+   }
+   else if ( is_palette )
+      return {};
+
+   Map<Idx>   map { png.width(), png.height() };
+   Vec<Byte>  row( png.row_bytes() );
+   for ( Size y = 0;  y < map.height();  ++y ) {
+      if ( not png.read_row(row.data()) )
+         return {};
+      for ( Size x = 0;  x < map.width();  ++x ) {
+         Idx value = is_palette? Idx( row[x] )
+                   : is_grey16?  (Idx(row[x*2]) << 8) | Idx(row[x*2+1])
+                   :             (Idx(row[x*4]) << 24) | (Idx(row[x*4+1]) << 16) | (Idx(row[x*4+2]) << 8) | Idx(row[x*4+3]);
+         if ( not table.empty() ) {
+            if ( value >= table.size() )
+               return {};
+            value = table[value];
+         }
+         map(x,y) = value;
+      }
+   }
+   return map;
+}
+
+// A cell map seen through a cell -> region label table. Lookups are resolved on
+// demand, so the same base map can back any number of region growing results.
+// The view refers to the base map, which must outlive it (hence no temporaries);
+// the same goes for the map passed to the grow_regions functions that return one.
+class RegionView {
+public:
+   RegionView( Map<Idx> const &cells, Vec<Idx> labels ):
+      m_cells  ( cells ),
+      m_labels ( std::move(labels) )
+   {}
+
+   RegionView( Map<Idx> const &&, Vec<Idx> ) = delete;
+
+   Idx operator()( Size x, Size y ) const {
+      return m_labels[ m_cells(x,y) ];
+   }
+
+   Idx operator()( V2u pos ) const {
+      return m_labels[ m_cells(pos) ];
+   }
+
+   // the region label of a Voronoi cell
+   Idx label( Idx cell ) const {
+      return m_labels[cell];
+   }
+
+   Vec<Idx> const& labels() const {
+      return m_labels;
+   }
+
+   Map<Idx> const& cells() const {
+      return m_cells;
+   }
+
+   inline Size width() const {
+      return m_cells.width();
+   }
+
+   inline Size height() const {
+      return m_cells.height();
+   }
+
+   inline V2u dimensions() const {
+      return m_cells.dimensions();
+   }
+
+   // writes the region label of every pixel into `target` (which may be the base map itself)
+   void materialize_into( Map<Idx> &target, ThreadPool &thread_pool = ThreadPool::shared() ) const {
+      DV_PROFILE_ZONE( "RegionView::materialize_into" );
+      assert( target.dimensions() == dimensions() );
+      Idx const *const  source = m_cells.data();
+      Idx       *const  dest   = target.data();
+      Size const        width  = m_cells.width();
+      thread_pool.parallel_for( m_cells.height(), [&]( Idx y ) {
+         for ( Size i = y * width, end = i + width;  i < end;  ++i )
+            dest[i] = m_labels[ source[i] ];
+      }, 16 );
+   }
+
+   Map<Idx> materialize( ThreadPool &thread_pool = ThreadPool::shared() ) const {
+      Map<Idx> map { dimensions() };
+      materialize_into( map, thread_pool );
+      return map;
+   }
+
+private:
+   Map<Idx> const &m_cells;  // base cell map (not owned)
+   Vec<Idx>        m_labels; // cell index -> region label
+};
+
 struct CellGrowth {
     Idx  index;
     Size max_remaining_growth;
 };
 
+// Scratch state of generate_growth_targets and grow_regions; pass the same
+// instance between calls to reuse its allocations.
+struct RegionGrowthWorkspace {
+   struct GrowingRegion {
+      Idx   index;                // cell index of the growth target
+      Size  max_remaining_growth;
+      Size  area = 1;             // number of cells in the region
+   };
+
+   CellAdjacency        adjacency;
+   UnionFind            cell_owner; // each set also tracks its lowest assimilated index
+   Vec<Idx>             region_of;  // region index per claimed cell, invalid_idx if unclaimed
+   Vec<GrowingRegion>   regions;
+   Vec<Vec<Idx>>        frontiers;  // candidate cells bordering each region
+   Vec<Idx>             active;     // indices of regions that can still grow
+   Vec<Idx>             labels;     // final cell -> region label remap table
+   Vec<Idx>             sample_buffer; // identity permutation between calls (see generate_growth_targets)
+   Vec<Idx>             sample_swaps;  // swap positions of the last sampling, for undoing it
+
+   IndexedHeap<F32>     growth_queue; // active regions by priority (prioritized growth)
+   Vec<Size>            candidate_counts; // unclaimed cells on each region's frontier (prioritized growth)
+   Vec<U64>             claim_keys; // per cell, lowest claim key of the current round (parallel growth)
+   Vec<Idx>             proposals;  // per active region, the cell it tries to claim this round
+
+   // sets up the regions of the growth targets and their initial frontiers
+   void prepare( Map<Idx> const &map, Size cell_count, Vec<CellGrowth> const &growth_targets ) {
+      DV_PROFILE_ZONE( "RegionGrowthWorkspace::prepare" );
+      cell_owner.reset( cell_count );
+      region_of.assign( cell_count, invalid_idx );
+      regions.clear();
+      active.clear();
+      adjacency.build( map, cell_count );
+
+      // growth target cells can never be assimilated by other regions
+      for ( auto const &target : growth_targets ) {
+         region_of[target.index] = regions.size();
+         active.push_back( regions.size() );
+         regions.push_back({ target.index, target.max_remaining_growth });
+      }
+
+      frontiers.resize( std::max(frontiers.size(), regions.size()) );
+      for ( Idx region_index = 0;  region_index < regions.size();  ++region_index ) {
+         auto &frontier = frontiers[region_index];
+         frontier.clear();
+         for ( auto neighbour : adjacency[regions[region_index].index] )
+            if ( region_of[neighbour] == invalid_idx )
+               frontier.push_back( neighbour );
+      }
+   }
+
+   // an unclaimed cell is on a region's frontier iff it borders a cell of that region
+   Bool is_on_frontier( Idx cell, Idx region_index, Idx excluded_cell=invalid_idx ) const {
+      for ( auto neighbour : adjacency[cell] )
+         if ( neighbour != excluded_cell and region_of[neighbour] == region_index )
+            return true;
+      return false;
+   }
+
+   // removes and returns a random unclaimed cell from the frontier (claimed ones are discarded lazily)
+   template <typename T_UnitRNG>
+   Idx take_random_candidate( Idx region_index, T_UnitRNG &&unit_rng ) {
+      auto &frontier = frontiers[region_index];
+      while ( regions[region_index].max_remaining_growth > 0 and not frontier.empty() ) {
+         Idx random_set_index = std::min<Idx>( unit_rng() * frontier.size(), frontier.size() - 1 );
+         Idx candidate        = frontier[random_set_index];
+         frontier[random_set_index] = frontier.back();
+         frontier.pop_back();
+         if ( region_of[candidate] == invalid_idx )
+            return candidate;
+      }
+      return invalid_idx;
+   }
+
+   // adds the unclaimed neighbours of a freshly assimilated cell to the region's frontier;
+   // returns how many were added
+   Size extend_frontier( Idx region_index, Idx assimilated_cell ) {
+      auto &frontier = frontiers[region_index];
+      Size const old_size = frontier.size();
+      for ( auto neighbour : adjacency[assimilated_cell] )
+         if ( region_of[neighbour] == invalid_idx and not is_on_frontier(neighbour, region_index, assimilated_cell) )
+            frontier.push_back( neighbour );
+      return frontier.size() - old_size;
+   }
+
+   // calls f once for every region other than region_index with a cell bordering `cell`;
+   // when `cell` is claimed, it drops off exactly these regions' frontiers
+   template <typename T_Function>
+   void for_each_other_bordering_region( Idx cell, Idx region_index, T_Function &&f ) const {
+      auto const &neighbours = adjacency[cell];
+      for ( Idx i = 0;  i < neighbours.size();  ++i ) {
+         Idx other = region_of[neighbours[i]];
+         if ( other == invalid_idx or other == region_index )
+            continue;
+         Bool is_repeat = false;
+         for ( Idx j = 0;  j < i and not is_repeat;  ++j )
+            is_repeat = region_of[neighbours[j]] == other;
+         if ( not is_repeat )
+            f( other );
+      }
+   }
+
+   // labels every cell with the lowest cell index of its region
+   RegionView view( Map<Idx> const &&map ) = delete;
+   RegionView view( Map<Idx> const &map ) {
+      DV_PROFILE_ZONE( "RegionGrowthWorkspace::view" );
+      Size const cell_count = cell_owner.size();
+      labels.resize( cell_count );
+      for ( Idx index = 0;  index < cell_count;  ++index )
+         labels[index] = cell_owner.lowest( index );
+      return RegionView( map, labels );
+   }
+};
+
 template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
 Vec<CellGrowth> generate_growth_targets( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram, 
                                          F32                                                percentage_of_growth_targets,
                                          U8                                                 min_target_growth,
                                          U8                                                 max_target_growth,
-                                         RNG::Engine                                       &rng_engine )
+                                         RNG::Engine                                       &rng_engine,
+                                         RegionGrowthWorkspace                             &workspace )
 {
-   Idx                largest_index     = voronoi_diagram.size() - 1;
-   Size               num_targets       = percentage_of_growth_targets * voronoi_diagram.size();
-   RNG::Int<Idx>      index_rng         = { rng_engine, 0, largest_index };
+   DV_PROFILE_ZONE( "generate_growth_targets" );
+   Size const         cell_count        = voronoi_diagram.size();
+   Size const         num_targets       = std::min<Size>( percentage_of_growth_targets * cell_count, cell_count );
+   RNG::Real<F64>     index_rng         = { rng_engine, .0, 1.0 };
    RNG::Int<U8>       target_growth_rng = { rng_engine, min_target_growth, max_target_growth };
    
    Vec<CellGrowth> growth_targets = {};
    growth_targets.reserve( num_targets );
-  
-   HashMap<Idx,Bool> claimed = {};
-   for ( auto index = voronoi_diagram.size();  index --> 0; )
-      claimed[index] = false;
 
-   while ( --num_targets ) {
-      Idx index; 
-      while ( claimed[index=index_rng()] );
-
-      growth_targets.push_back({ index, target_growth_rng()  });
-      claimed[index] = true;
+   // partial Fisher-Yates shuffle over the reusable index buffer;
+   // the swaps are undone afterwards so the buffer is the identity again
+   auto &indices = workspace.sample_buffer;
+   auto &swaps   = workspace.sample_swaps;
+   for ( auto index = indices.size();  index < cell_count;  ++index )
+      indices.push_back( index );
+   swaps.clear();
+
+   for ( Idx i = 0;  i < num_targets;  ++i ) {
+      Idx remaining = cell_count - i;
+      Idx j         = i + std::min<Idx>( index_rng() * remaining, remaining - 1 );
+      std::swap( indices[i], indices[j] );
+      swaps.push_back( j );
+
+      growth_targets.push_back({ indices[i], target_growth_rng()  });
    }
+
+   for ( auto i = swaps.size();  i --> 0; )
+      std::swap( indices[i], indices[swaps[i]] );
+
    return growth_targets;
 }
 
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+Vec<CellGrowth> generate_growth_targets( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram, 
+                                         F32                                                percentage_of_growth_targets,
+                                         U8                                                 min_target_growth,
+                                         U8                                                 max_target_growth,
+                                         RNG::Engine                                       &rng_engine )
+{
+   RegionGrowthWorkspace workspace;
+   return generate_growth_targets( voronoi_diagram, percentage_of_growth_targets, min_target_growth, max_target_growth, rng_engine, workspace );
+}
 
 // TODO: categorize map border (W,E,N,S)
 // for pole/ocean generation
 
 template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
-void grow_regions( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
-                   Map<Idx>                                          &map,
-                   Vec<CellGrowth>                                   &growth_targets,
-                   RNG::Engine                                       &rng_engine ) 
+RegionView grow_regions( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                         Map<Idx> const                                    &map,
+                         Vec<CellGrowth> const                             &growth_targets,
+                         RNG::Engine                                       &rng_engine,
+                         RegionGrowthWorkspace                             &workspace ) 
 {
-   // TODO: grow big areas first?
-   
-   auto neighbour_map = generate_neighbour_map( map );
+   DV_PROFILE_ZONE( "grow_regions" );
+   // NOTE: see grow_regions_prioritized for control over which areas grow first
+
+   workspace.prepare( map, voronoi_diagram.size(), growth_targets );
+   auto &regions = workspace.regions;
+   auto &active  = workspace.active;
+
+   // the frontier of active regions, advanced round-robin (one cell per region per round)
+   RNG::Real<>  rng( rng_engine, .0f, 1.0f );
+   while ( not active.empty() ) {
+      Size remaining_count = 0;
+      for ( auto region_index : active ) {
+         auto &region = regions[region_index];
+         // select a random unclaimed neighbour:
+         Idx random_neighbour_index = workspace.take_random_candidate( region_index, rng );
+         // retire the region if growth is no longer possible:
+         if ( random_neighbour_index == invalid_idx )
+            continue;
+         // otherwise assimilate the random neighbour:
+         workspace.extend_frontier( region_index, random_neighbour_index );
+         workspace.region_of[random_neighbour_index] = region_index;
+         workspace.cell_owner.unite( region.index, random_neighbour_index );
+         region.max_remaining_growth--;
+         region.area++;
+         active[remaining_count++] = region_index; // keep it in the frontier (order preserving)
+      }
+      active.resize( remaining_count );
+   }
+
+   return workspace.view( map );
+   // NOTE: see move_centres_to_centroids (RegionStatistics.hpp) for updating the Voronoi diagram centres
+}
+
+// the returned view refers to the map, so it must not be a temporary (likewise below)
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions( Voronoi<T_is_tiled, T_threshold_percentage> const &,
+                         Map<Idx> const                                    &&,
+                         Vec<CellGrowth> const                             &,
+                         RNG::Engine                                       &,
+                         RegionGrowthWorkspace                             & ) = delete;
 
-   // remove growth target cells from neighbour sets
-   for ( auto &[key,set] : neighbour_map )
-      for ( auto target : growth_targets )
-         if ( set.contains(target.index) )
-            set.remove( target.index );
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                         Map<Idx> const                                    &map,
+                         Vec<CellGrowth> const                             &growth_targets,
+                         RNG::Engine                                       &rng_engine ) 
+{
+   RegionGrowthWorkspace workspace;
+   return grow_regions( voronoi_diagram, map, growth_targets, rng_engine, workspace );
+}
 
-   // initialize cells' lowest assimilated index map
-   HashMap<Idx,Idx>  lowest_assimilated_index;
-   for ( auto index = voronoi_diagram.size();  index --> 0; )
-      lowest_assimilated_index[index] = index;
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions( Voronoi<T_is_tiled, T_threshold_percentage> const &,
+                         Map<Idx> const                                    &&,
+                         Vec<CellGrowth> const                             &,
+                         RNG::Engine                                       & ) = delete;
+
+// What a region growth priority function gets to see of a region.
+struct RegionPriorityInput {
+   Size  area;             // cells assimilated so far (including the growth target)
+   Size  remaining_growth;
+   Size  candidate_count;  // unclaimed cells on the region's frontier (not its border length)
+   F32   weight;           // summed Voronoi weights of the region's cells
+};
 
-   // initialize cell ownership map
-   HashMap<Idx,Idx>  cell_owner;
-   for ( auto index = voronoi_diagram.size();  index --> 0; )
-      cell_owner[index] = index;
+// Maps a region to its growth priority (higher grows first).
+template <typename T>
+concept RegionPriority = std::regular_invocable<T const &, RegionPriorityInput const &>
+                     and std::convertible_to<std::invoke_result_t<T const &, RegionPriorityInput const &>, F32>;
+
+struct LargestRemainingGrowthFirst {
+   F32 operator()( RegionPriorityInput const &region ) const {
+      return F32( region.remaining_growth );
+   }
+};
+
+struct LargestAreaFirst {
+   F32 operator()( RegionPriorityInput const &region ) const {
+      return F32( region.area );
+   }
+};
+
+struct SmallestAreaFirst { // size-balanced growth
+   F32 operator()( RegionPriorityInput const &region ) const {
+      return -F32( region.area );
+   }
+};
+
+struct MostCandidatesFirst { // favours regions with room to grow
+   F32 operator()( RegionPriorityInput const &region ) const {
+      return F32( region.candidate_count );
+   }
+};
+
+struct HeaviestFirst {
+   F32 operator()( RegionPriorityInput const &region ) const {
+      return region.weight;
+   }
+};
+
+// Grows one cell at a time, always for the region with the highest priority
+// (ties go to the lower region index). Priorities are re-evaluated after every step, for the
+// grown region and for every region that lost a frontier cell to it.
+template <RegionPriority T_RegionPriority = LargestRemainingGrowthFirst, Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_prioritized( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                                     Map<Idx> const                                    &map,
+                                     Vec<CellGrowth> const                             &growth_targets,
+                                     RNG::Engine                                       &rng_engine,
+                                     RegionGrowthWorkspace                             &workspace,
+                                     T_RegionPriority                                   priority_of = {} ) 
+{
+   DV_PROFILE_ZONE( "grow_regions_prioritized" );
+   workspace.prepare( map, voronoi_diagram.size(), growth_targets );
+   auto &regions = workspace.regions;
+   auto &queue   = workspace.growth_queue;
+
+   // frontiers hold claimed cells until they are drawn, so their sizes are not candidate counts
+   auto &candidate_counts = workspace.candidate_counts;
+   candidate_counts.resize( regions.size() );
+   Vec<F32> weights( regions.size() );
+   for ( Idx region_index = 0;  region_index < regions.size();  ++region_index ) {
+      weights[region_index]          = voronoi_diagram.getCentre( regions[region_index].index ).weight;
+      candidate_counts[region_index] = workspace.frontiers[region_index].size();
+   }
+
+   auto const priority = [&]( Idx region_index ) {
+      auto const &region = regions[region_index];
+      return priority_of( RegionPriorityInput { region.area,
+                                                region.max_remaining_growth,
+                                                candidate_counts[region_index],
+                                                weights[region_index] } );
+   };
+
+   queue.reset( regions.size() );
+   for ( auto region_index : workspace.active )
+      queue.push( region_index, priority(region_index) );
 
    RNG::Real<>  rng( rng_engine, .0f, 1.0f );
-   while ( not growth_targets.empty() ) {
-      for ( auto &growth_target : growth_targets ) {
-         auto &neighbour_set = neighbour_map[growth_target.index];
-         // remove growth_target if growth is no longer possible:
-         if ( (growth_target.max_remaining_growth < 1) or neighbour_set.empty() ) {
-            growth_targets.erase(
-               std::remove_if(   growth_targets.begin(),
-                                 growth_targets.end(),
-                                 [&growth_target]( CellGrowth const &e ) {
-                                    return e.index == growth_target.index;
-                                 } ),
-               growth_targets.end()
-            );
-         }
-         else { // otherwise grow by one cell:
-            // select random neighbour
-            Idx  random_set_index       = rng() * neighbour_set.size();
-            Idx  random_neighbour_index = neighbour_set[random_set_index];
-            neighbour_set.remove( random_neighbour_index );
-            // remove from all neighbour lists:
-            for ( auto &[key,set] : neighbour_map )
-               set.remove( random_neighbour_index );
-            
-            // assimilate the random neighbour:
-            
-            // assimilate all neighbours of the random cell_owner
-            for ( auto &neighbour : neighbour_map[random_neighbour_index] )
-               neighbour_set.insert( neighbour );
-            // update lowest assimilated index if necessary:
-            cell_owner[random_neighbour_index] = growth_target.index;
-            if ( random_neighbour_index < growth_target.index )
-               lowest_assimilated_index[growth_target.index] = random_neighbour_index;
-
-            growth_target.max_remaining_growth--;
+   while ( not queue.empty() ) {
+      Idx  region_index = queue.top();
+      auto &region      = regions[region_index];
+      Idx  random_neighbour_index = workspace.take_random_candidate( region_index, rng );
+      // retire the region if growth is no longer possible:
+      if ( random_neighbour_index == invalid_idx ) {
+         queue.pop();
+         continue;
+      }
+      candidate_counts[region_index] += workspace.extend_frontier( region_index, random_neighbour_index );
+      candidate_counts[region_index]--;
+      // the claimed cell is no longer a candidate of the other regions it borders:
+      workspace.for_each_other_bordering_region( random_neighbour_index, region_index, [&]( Idx other ) {
+         candidate_counts[other]--;
+         if ( queue.contains(other) )
+            queue.update( other, priority(other) );
+      });
+      workspace.region_of[random_neighbour_index] = region_index;
+      workspace.cell_owner.unite( region.index, random_neighbour_index );
+      weights[region_index] += voronoi_diagram.getCentre( random_neighbour_index ).weight;
+      region.max_remaining_growth--;
+      region.area++;
+      queue.update( region_index, priority(region_index) );
+   }
+   workspace.active.clear();
+
+   return workspace.view( map );
+}
+
+template <RegionPriority T_RegionPriority = LargestRemainingGrowthFirst, Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_prioritized( Voronoi<T_is_tiled, T_threshold_percentage> const &,
+                                     Map<Idx> const                                    &&,
+                                     Vec<CellGrowth> const                             &,
+                                     RNG::Engine                                       &,
+                                     RegionGrowthWorkspace                             &,
+                                     T_RegionPriority                                   = {} ) = delete;
+
+// Grows all regions concurrently in bulk-synchronous rounds. Every round each active
+// region proposes one cell; when several regions propose the same cell, the lowest
+// claim key (a hash of seed, round and region) wins. Each region draws from its own
+// counter-based stream, so the result only depends on the engine state, not on the thread count.
+// is_stop_requested (if given) is polled between rounds; once it returns true, growth stops and
+// the regions grown so far are returned.
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_parallel( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                                  Map<Idx> const                                    &map,
+                                  Vec<CellGrowth> const                             &growth_targets,
+                                  RNG::Engine                                       &rng_engine,
+                                  RegionGrowthWorkspace                             &workspace,
+                                  ThreadPool                                        &thread_pool = ThreadPool::shared(),
+                                  Fun<Bool> const                                   &is_stop_requested = {} ) 
+{
+   DV_PROFILE_ZONE( "grow_regions_parallel" );
+   static constexpr U64  no_claim    = std::numeric_limits<U64>::max();
+   static constexpr U64  region_bits = 0xFFFF'FFFFULL; // low bits of a claim key hold the region index
+
+   Size const cell_count = voronoi_diagram.size();
+   workspace.prepare( map, cell_count, growth_targets );
+   assert( workspace.regions.size() <= region_bits );
+
+   auto &regions    = workspace.regions;
+   auto &active     = workspace.active;
+   auto &region_of  = workspace.region_of;
+   auto &proposals  = workspace.proposals;
+   auto &claim_keys = workspace.claim_keys;
+   claim_keys.assign( cell_count, no_claim );
+
+   U64 const                 seed = RNG::Int<U64>{ rng_engine, 0, std::numeric_limits<U64>::max() }();
+   RNG::CounterEngine const  root { seed };
+   Vec<RNG::CounterEngine>   streams;
+   streams.reserve( regions.size() );
+   for ( Idx region_index = 0;  region_index < regions.size();  ++region_index )
+      streams.push_back( root.split(region_index) );
+
+   Size constexpr grain = 64;
+   for ( U64 round = 0;  not active.empty();  ++round ) {
+      if ( is_stop_requested and is_stop_requested() )
+         break;
+      proposals.resize( active.size() );
+      // propose: every active region picks a candidate and bids for it
+      thread_pool.parallel_for( active.size(), [&]( Idx i ) {
+         Idx  region_index = active[i];
+         auto &stream      = streams[region_index];
+         Idx  candidate    = workspace.take_random_candidate( region_index, [&stream] { return stream.unit(); } );
+         proposals[i]      = candidate;
+         if ( candidate == invalid_idx )
+            return;
+         U64 key = (mix64(seed + mix64(round ^ (U64(region_index) << 32))) & ~region_bits) | region_index;
+         std::atomic_ref<U64> best( claim_keys[candidate] );
+         for ( U64 current = best.load();  key < current and not best.compare_exchange_weak(current, key); );
+      }, grain );
+      // resolve: the lowest bid claims the cell
+      thread_pool.parallel_for( active.size(), [&]( Idx i ) {
+         Idx candidate = proposals[i];
+         if ( candidate != invalid_idx and (claim_keys[candidate] & region_bits) == active[i] )
+            region_of[candidate] = active[i];
+      }, grain );
+      // extend: winners grow their frontiers; bids are cleared for the next round
+      thread_pool.parallel_for( active.size(), [&]( Idx i ) {
+         Idx candidate = proposals[i];
+         if ( candidate == invalid_idx )
+            return;
+         if ( region_of[candidate] == active[i] )
+            workspace.extend_frontier( active[i], candidate );
+         std::atomic_ref<U64>( claim_keys[candidate] ).store( no_claim, std::memory_order_relaxed );
+      }, grain );
+      // retire regions that could not propose, book-keep the winners
+      Size remaining_count = 0;
+      for ( Idx i = 0;  i < active.size();  ++i ) {
+         Idx region_index = active[i],
+             candidate    = proposals[i];
+         if ( candidate == invalid_idx )
+            continue;
+         if ( region_of[candidate] == region_index ) {
+            workspace.cell_owner.unite( regions[region_index].index, candidate );
+            regions[region_index].max_remaining_growth--;
+            regions[region_index].area++;
          }
+         active[remaining_count++] = region_index;
       }
+      active.resize( remaining_count );
    }
 
-   // update map: // TODO: remove later and instead just keep the cell owner map
-   for ( auto &index : map )
-      index = lowest_assimilated_index[cell_owner[index]];
-      // TODO: update Voronoi diagram centres 
+   return workspace.view( map );
 }
 
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_parallel( Voronoi<T_is_tiled, T_threshold_percentage> const &,
+                                  Map<Idx> const                                    &&,
+                                  Vec<CellGrowth> const                             &,
+                                  RNG::Engine                                       &,
+                                  RegionGrowthWorkspace                             &,
+                                  ThreadPool                                        & = ThreadPool::shared(),
+                                  Fun<Bool> const                                   & = {} ) = delete;
+
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_parallel( Voronoi<T_is_tiled, T_threshold_percentage> const &voronoi_diagram,
+                                  Map<Idx> const                                    &map,
+                                  Vec<CellGrowth> const                             &growth_targets,
+                                  RNG::Engine                                       &rng_engine ) 
+{
+   RegionGrowthWorkspace workspace;
+   return grow_regions_parallel( voronoi_diagram, map, growth_targets, rng_engine, workspace );
+}
+
+template <Bool T_is_tiled = false, U8 T_threshold_percentage=10>
+RegionView grow_regions_parallel( Voronoi<T_is_tiled, T_threshold_percentage> const &,
+                                  Map<Idx> const                                    &&,
+                                  Vec<CellGrowth> const                             &,
+                                  RNG::Engine                                       & ) = delete;
+
 // EOF
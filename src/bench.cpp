@@ -0,0 +1,319 @@
+// dv1478_bench: micro- and macrobenchmarks of the generation pipeline.
+//
+// usage: dv1478_bench [--quick] [--filter <substring>] [--out <file.json>]
+//
+// Every benchmark builds its input from fixed RNG::Engine seeds and reports a checksum of its
+// output next to the timings, so runs are comparable across commits and machines; a changed
+// checksum means the benchmark measured different work. Results are written as JSON.
+
+#include "falk/StringHash.hpp"
+#include "falk/Voronoi.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string_view>
+
+namespace {
+   U64 constexpr seed = 1478;
+
+   struct BenchParams {
+      Size              side       = 0;
+      Size              cell_count = 0; // element count for microbenchmarks
+      DistanceFunction  metric     = DistanceFunction::euclidean;
+   };
+
+   struct BenchResult {
+      Str          name;
+      BenchParams  params;
+      Size         repetitions;
+      F64          median_ns;
+      F64          min_ns;
+      U64          checksum;
+      Bool         is_deterministic; // every repetition reproduced the checksum
+   };
+
+   struct BenchConfig {
+      Bool  is_quick = false;
+      Str   filter;
+      Str   output_path;
+   };
+
+   char const* metric_name( DistanceFunction metric ) {
+      switch ( metric ) {
+         case DistanceFunction::manhattan: return "manhattan";
+         case DistanceFunction::euclidean: return "euclidean";
+         case DistanceFunction::chebychev: return "chebychev";
+         case DistanceFunction::weirdness: return "weirdness";
+      }
+      return "?";
+   }
+
+   U64 fnv1a( U64 hash, U64 value ) {
+      return (hash ^ value) * 0x100'0000'01B3ULL;
+   }
+
+   U64 map_checksum( Map<Idx> const &map ) {
+      U64 hash = 0xCBF2'9CE4'8422'2325ULL;
+      for ( Size i = 0;  i < map.size();  ++i )
+         hash = fnv1a( hash, map.data()[i] );
+      return hash;
+   }
+
+   // hash of a file's bytes (0 if it cannot be read); string_hash runs at memory speed, so reading
+   // the file back costs little next to the deflating that produced it
+   U64 file_checksum( Str const &path ) {
+      std::error_code error;
+      Size const size = std::filesystem::file_size( path, error );
+      std::FILE *file = error? nullptr : std::fopen( path.c_str(), "rb" );
+      if ( not file )
+         return 0;
+      Str bytes( size, '\0' );
+      Bool const is_read = std::fread( bytes.data(), 1, size, file ) == size;
+      std::fclose( file );
+      return is_read? string_hash( bytes ) : 0;
+   }
+
+   // runs body() (which returns a checksum) at least min_repetitions times and for at least
+   // min_seconds, after one untimed warm-up run
+   template <typename T_Body>
+   BenchResult measure( Str name, BenchParams params, BenchConfig const &config, T_Body &&body ) {
+      using Clock = std::chrono::steady_clock;
+      Size const  min_repetitions = config.is_quick?   3  :    7;
+      F64 const   min_seconds     = config.is_quick?  .1  :  .5;
+      U64 const   checksum        = body();
+      Bool        is_deterministic = true;
+      Vec<F64>    times_ns;
+      for ( F64 total_seconds = 0;  times_ns.size() < min_repetitions or total_seconds < min_seconds; ) {
+         auto const start = Clock::now();
+         U64 const  repeated_checksum = body();
+         F64 const  elapsed_ns = std::chrono::duration<F64,std::nano>( Clock::now() - start ).count();
+         if ( repeated_checksum != checksum and is_deterministic ) {
+            std::fprintf( stderr, "%s: checksum %016llx of repetition %zu differs from %016llx; benchmarks must be deterministic\n",
+                          name.c_str(), (unsigned long long) repeated_checksum, times_ns.size() + 1, (unsigned long long) checksum );
+            is_deterministic = false;
+         }
+         times_ns.push_back( elapsed_ns );
+         total_seconds += elapsed_ns * 1e-9;
+      }
+      std::sort( times_ns.begin(), times_ns.end() );
+      BenchResult result { std::move(name), params, times_ns.size(), times_ns[times_ns.size() / 2], times_ns.front(), checksum, is_deterministic };
+      std::fprintf( stderr, "%-24s side %5zu  cells %6zu  %-9s  median %12.0f ns  min %12.0f ns\n",
+                    result.name.c_str(), params.side, params.cell_count, metric_name(params.metric),
+                    result.median_ns, result.min_ns );
+      return result;
+   }
+
+   Voronoi<true> make_voronoi( BenchParams const &params ) {
+      RNG::Engine     rng_engine { seed };
+      RNG::Real<F32>  rng_axis_pos { rng_engine, .0f, F32(params.side) };
+      Voronoi<true>   voronoi { V2f(params.side, params.side), params.cell_count };
+      for ( Size i = 0;  i < params.cell_count;  ++i ) {
+         V2f pos = { rng_axis_pos(), rng_axis_pos() };
+         voronoi.addCentre( pos );
+      }
+      return voronoi;
+   }
+
+   Map<Idx> to_map( Voronoi<true> const &voronoi, BenchParams const &params ) {
+      V2u const dimensions( params.side, params.side );
+      switch ( params.metric ) {
+         default:
+         case DistanceFunction::euclidean: return voronoi.toMap<EuclideanDistance>( dimensions );
+         case DistanceFunction::manhattan: return voronoi.toMap<ManhattanDistance>( dimensions );
+         case DistanceFunction::chebychev: return voronoi.toMap<ChebychevDistance>( dimensions );
+         case DistanceFunction::weirdness: return voronoi.toMap<WeirdnessDistance>( dimensions );
+      }
+   }
+
+   template <typename T_Distance>
+   U64 sum_distances( Vec<V2f> const &points ) {
+      T_Distance distance_between;
+      F64 sum = 0;
+      for ( Size i = 1;  i < points.size();  ++i )
+         sum += distance_between( points[i-1], points[i] );
+      return static_cast<U64>( sum );
+   }
+
+   void run_micro_benchmarks( BenchConfig const &config, Vec<BenchResult> &results ) {
+      auto const is_selected = [&]( Str const &name ) {
+         return config.filter.empty() or name.find(config.filter) != Str::npos;
+      };
+      Size const count = config.is_quick? 1 << 16 : 1 << 20;
+
+      // distance kernels over consecutive pairs of random points
+      RNG::Engine     rng_engine { seed };
+      RNG::Real<F32>  rng_coordinate { rng_engine, .0f, 1024.0f };
+      Vec<V2f>        points( count );
+      for ( auto &point : points )
+         point = V2f( rng_coordinate(), rng_coordinate() );
+      for ( auto metric : { DistanceFunction::manhattan, DistanceFunction::euclidean,
+                            DistanceFunction::chebychev, DistanceFunction::weirdness } ) {
+         if ( not is_selected("distance") )
+            break;
+         BenchParams const params { 0, count, metric };
+         results.push_back( measure("distance", params, config, [&] {
+            switch ( metric ) {
+               case DistanceFunction::manhattan: return sum_distances<ManhattanDistance>( points );
+               case DistanceFunction::euclidean: return sum_distances<EuclideanDistance>( points );
+               case DistanceFunction::chebychev: return sum_distances<ChebychevDistance>( points );
+               case DistanceFunction::weirdness: return sum_distances<WeirdnessDistance>( points );
+            }
+            return U64(0);
+         }) );
+      }
+
+      // RandomAccessHashSet: inserts, random access and removals (as region growing uses it)
+      if ( is_selected("random_access_hash_set") ) {
+         Vec<Idx> keys( count );
+         RNG::Int<Idx> rng_key { rng_engine, 0, count * 4 };
+         for ( auto &key : keys )
+            key = rng_key();
+         results.push_back( measure("random_access_hash_set", { 0, count }, config, [&] {
+            RandomAccessHashSet<Idx> set;
+            U64 hash = 0;
+            for ( auto key : keys )
+               set.insert( key );
+            for ( Size i = 0;  i < count;  i += 7 )
+               hash = fnv1a( hash, set[ keys[i] % set.size() ] );
+            for ( Size i = 0;  i < count;  i += 2 )
+               set.remove( keys[i] );
+            return fnv1a( hash, set.size() );
+         }) );
+      }
+
+      // string_hash and transparent StrHashMap lookups on asset-table style keys
+      if ( is_selected("string_hash") ) {
+         Vec<Str> keys( count / 16 );
+         for ( Idx i = 0;  i < keys.size();  ++i )
+            keys[i] = "assets/maps/region_" + std::to_string( i ) + ".dvmap";
+         StrHashMap<Idx> table;
+         for ( Idx i = 0;  i < keys.size();  ++i )
+            table.emplace( keys[i], i );
+         results.push_back( measure("string_hash", { 0, keys.size() }, config, [&] {
+            U64 hash = 0;
+            for ( auto const &key : keys )
+               hash = fnv1a( hash, string_hash(key) );
+            for ( auto const &key : keys )
+               hash = fnv1a( hash, table.find(std::string_view(key))->second );
+            return hash;
+         }) );
+      }
+
+      // Map::get_neighbours over every pixel
+      if ( is_selected("get_neighbours") ) {
+         BenchParams const params { config.is_quick? 256U : 1024U, 1024 };
+         auto const voronoi = make_voronoi( params );
+         auto const map     = to_map( voronoi, params );
+         results.push_back( measure("get_neighbours", params, config, [&] {
+            U64 hash = 0;
+            for ( U32 y = 0;  y < map.height();  ++y )
+               for ( U32 x = 0;  x < map.width();  ++x )
+                  for ( auto neighbour : map.get_neighbours(V2u(x,y)) )
+                     hash += neighbour;
+            return hash;
+         }) );
+      }
+   }
+
+   void run_macro_benchmarks( BenchConfig const &config, Vec<BenchResult> &results ) {
+      auto const is_selected = [&]( Str const &name ) {
+         return config.filter.empty() or name.find(config.filter) != Str::npos;
+      };
+      Vec<Size> const sides       = config.is_quick? Vec<Size>{ 128, 256 }   : Vec<Size>{ 256, 512, 1024 };
+      Vec<Size> const cell_counts = config.is_quick? Vec<Size>{ 64, 256 }    : Vec<Size>{ 256, 1024, 4096 };
+      Vec<DistanceFunction> const metrics { DistanceFunction::euclidean, DistanceFunction::manhattan };
+      auto const png_path = ( std::filesystem::temp_directory_path() / "dv1478_bench.png" ).string();
+
+      for ( auto side : sides ) {
+         for ( auto cell_count : cell_counts ) {
+            for ( auto metric : metrics ) {
+               BenchParams const  params  { side, cell_count, metric };
+               auto const         voronoi = make_voronoi( params );
+               auto const         map     = to_map( voronoi, params );
+
+               if ( is_selected("to_map") )
+                  results.push_back( measure("to_map", params, config, [&] {
+                     return map_checksum( to_map(voronoi, params) );
+                  }) );
+               if ( metric != metrics.front() )
+                  continue; // the remaining stages don't depend on the metric beyond their input
+               if ( is_selected("generate_neighbour_map") )
+                  results.push_back( measure("generate_neighbour_map", params, config, [&] {
+                     U64 hash = 0;
+                     for ( auto const &[cell,neighbours] : generate_neighbour_map(map) )
+                        hash += fnv1a( cell, neighbours.size() );
+                     return hash;
+                  }) );
+               if ( is_selected("grow_regions") ) {
+                  RegionGrowthWorkspace workspace;
+                  results.push_back( measure("grow_regions", params, config, [&] {
+                     RNG::Engine rng_engine { seed };
+                     auto targets = generate_growth_targets( voronoi, .33f, 2, 13, rng_engine, workspace );
+                     return map_checksum( grow_regions<true>(voronoi, map, targets, rng_engine, workspace).materialize() );
+                  }) );
+                  results.push_back( measure("grow_regions_parallel", params, config, [&] {
+                     RNG::Engine rng_engine { seed };
+                     auto targets = generate_growth_targets( voronoi, .33f, 2, 13, rng_engine, workspace );
+                     return map_checksum( grow_regions_parallel<true>(voronoi, map, targets, rng_engine, workspace).materialize() );
+                  }) );
+               }
+               if ( is_selected("map2png") )
+                  results.push_back( measure("map2png", params, config, [&] {
+                     Bool const is_ok = map2png( map, png_path );
+                     return is_ok? file_checksum( png_path ) : 0;
+                  }) );
+            }
+         }
+      }
+      std::filesystem::remove( png_path );
+   }
+
+   Bool write_json( Str const &path, BenchConfig const &config, Vec<BenchResult> const &results ) {
+      std::FILE *file = path.empty()? stdout : std::fopen( path.c_str(), "w" );
+      if ( not file )
+         return false;
+      std::fprintf( file, "{\n  \"version\": 1,\n  \"seed\": %llu,\n  \"quick\": %s,\n  \"threads\": %zu,\n  \"results\": [\n",
+                    (unsigned long long) seed, config.is_quick? "true" : "false", ThreadPool::shared().thread_count() );
+      for ( Idx i = 0;  i < results.size();  ++i ) {
+         auto const &r = results[i];
+         std::fprintf( file, "    { \"name\": \"%s\", \"side\": %zu, \"cells\": %zu, \"metric\": \"%s\", "
+                             "\"repetitions\": %zu, \"median_ns\": %.0f, \"min_ns\": %.0f, \"checksum\": \"%016llx\", "
+                             "\"deterministic\": %s }%s\n",
+                       r.name.c_str(), r.params.side, r.params.cell_count, metric_name(r.params.metric),
+                       r.repetitions, r.median_ns, r.min_ns, (unsigned long long) r.checksum,
+                       r.is_deterministic? "true" : "false",
+                       i + 1 < results.size()? "," : "" );
+      }
+      std::fprintf( file, "  ]\n}\n" );
+      return path.empty() or std::fclose( file ) == 0;
+   }
+}
+
+I32 main( I32 argc, char const *argv[] ) {
+   BenchConfig config;
+   for ( I32 i = 1;  i < argc;  ++i ) {
+      Str const arg = argv[i];
+      if ( arg == "--quick" )
+         config.is_quick = true;
+      else if ( arg == "--filter" and i + 1 < argc )
+         config.filter = argv[++i];
+      else if ( arg == "--out" and i + 1 < argc )
+         config.output_path = argv[++i];
+      else {
+         std::fprintf( stderr, "usage: %s [--quick] [--filter <substring>] [--out <file.json>]\n", argv[0] );
+         return 1;
+      }
+   }
+   Vec<BenchResult> results;
+   run_micro_benchmarks( config, results );
+   run_macro_benchmarks( config, results );
+   Bool const is_deterministic = std::all_of( results.begin(), results.end(),
+                                              []( BenchResult const &r ) { return r.is_deterministic; } );
+   if ( not is_deterministic )
+      std::fprintf( stderr, "non-deterministic benchmarks; see above\n" );
+   return write_json( config.output_path, config, results ) and is_deterministic? 0 : 1;
+}
+
+// EOF
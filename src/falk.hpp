@@ -1,5 +1,7 @@
 // Headers {{{
    #include <string>
+   #include <string_view>
+   #include "StringHash.hpp"
    #include <vector>
    #include <utility>
    #include <iostream>
@@ -62,18 +64,23 @@
 // Global Constants }}}
 // Implementations {{{
    // String Hashing {{{
+   // word-at-a-time, see StringHash.hpp; the same values at compile time and at run time
    namespace falk {
-      constexpr inline I64 hash( char const *c_str, I32 offset=0 ) noexcept {
-         return c_str[offset]? (hash(c_str,offset+1)*33) xor c_str[offset]  :  5381;
+      constexpr inline I64 hash( std::string_view s ) noexcept {
+         return static_cast<I64>( string_hash(s) );
+      }
+      constexpr inline I64 hash( char const *c_str ) noexcept {
+         return hash( std::string_view(c_str) );
       }
       inline I64 hash( std::string const &s ) noexcept {
-         return hash( s.c_str() );
+         return hash( std::string_view(s) );
       }
    }
    // hash string literal operator
-   constexpr inline I64 operator ""_h( char const *c_str, size_t ) noexcept {
-      return falk::hash( c_str );
+   constexpr inline I64 operator ""_h( char const *c_str, size_t length ) noexcept {
+      return falk::hash( std::string_view(c_str, length) );
    }
+   static_assert( "falk"_h == static_cast<I64>(string_hash("falk")) and "falk"_h == falk::hash("falk") );
    // String Hashing }}}
    // Random Access IPair Iteration {{{
    template <class T_RandomAccessCollection>
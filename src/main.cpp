@@ -3,73 +3,424 @@
 #ifdef HELLOIMGUI_USE_SDL_OPENGL3
    #include <SDL.h>
 #endif
+// the preview needs an OpenGL renderer; older hello_imgui versions only announce it by backend
+#if defined(HELLOIMGUI_HAS_OPENGL) or defined(HELLOIMGUI_USE_SDL_OPENGL3) or defined(HELLOIMGUI_USE_GLFW_OPENGL3)
+   #define DV1478_HAS_OPENGL_PREVIEW
+   #include "hello_imgui/hello_imgui_include_opengl.h"
+#endif
 
+#define DV1478_ALLOCATION_TRACKER_IMPLEMENTATION // (only has an effect with DV1478_TRACK_ALLOCATIONS)
 #include "falk/Voronoi.hpp"
+#include "falk/Log.hpp"
+#include "falk/GenerationMonitor.hpp"
 
-I32 _main( I32 const argc, char const *argv[] ) {
-   DistanceFunction distance_function = DistanceFunction::euclidean;
-   if ( argc != 1 ) { // if decided through command-line arg:
-      Str distance_function_arg { argv[1] };
-      if ( distance_function_arg =="Euclidean" or distance_function_arg =="euclidean" )
-         distance_function = DistanceFunction::euclidean;
-      else if ( distance_function_arg =="Manhattan" or distance_function_arg =="manhattan" )
-         distance_function = DistanceFunction::manhattan;
-      else if ( distance_function_arg =="Chebychev" or distance_function_arg =="chebychev" )
-         distance_function = DistanceFunction::chebychev;
-      else if ( distance_function_arg =="Weirdness" or distance_function_arg =="weirdness" )
-         distance_function = DistanceFunction::weirdness;
-      else assert( false and "Valid distance functions are: Euclidean, Manhattan, Chebychev, Weirdness" );
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+// parameters of one generated map (the positional command-line arguments of _main)
+struct MapJob {
+   DistanceFunction  distance_function = DistanceFunction::euclidean;
+   Str               filename          = "output.png";
+   U32               side              = 512;
+   U32               cell_count        = 1024;
+   F32               weight_min        = 1.0f;
+   F32               weight_max        = 1.0f;
+   Opt<U64>          seed;
+};
+
+// buffers that are reused from one job to the next
+struct MapJobContext {
+   Voronoi<true>           voronoi   { V2f(.0f, .0f) };
+   Map<Idx>                map       { V2u(0, 0) };
+   RegionGrowthWorkspace   workspace;
+   Vec<F32>                centre_positions, // x and y of every centre
+                           centre_weights;
+};
+
+Opt<DistanceFunction> parse_distance_function( Str const &arg ) {
+   if ( arg == "Euclidean" or arg == "euclidean" ) return DistanceFunction::euclidean;
+   if ( arg == "Manhattan" or arg == "manhattan" ) return DistanceFunction::manhattan;
+   if ( arg == "Chebychev" or arg == "chebychev" ) return DistanceFunction::chebychev;
+   if ( arg == "Weirdness" or arg == "weirdness" ) return DistanceFunction::weirdness;
+   return {};
+}
+
+// parses "<distance function> [filename] [side] [cell count] [weight min] [weight max] [seed]"
+Opt<MapJob> parse_map_job( Vec<Str> const &args ) {
+   MapJob job;
+   try {
+      if ( args.size() > 0 ) {
+         auto maybe_distance_function = parse_distance_function( args[0] );
+         if ( not maybe_distance_function )
+            return {};
+         job.distance_function = maybe_distance_function.value();
+      }
+      if ( args.size() > 1 ) job.filename   = args[1];
+      if ( args.size() > 2 ) job.side       = std::stoi(  args[2] );
+      if ( args.size() > 3 ) job.cell_count = std::stoi(  args[3] );
+      if ( args.size() > 4 ) job.weight_min = std::stof(  args[4] );
+      if ( args.size() > 5 ) job.weight_max = std::stof(  args[5] );
+      if ( args.size() > 6 ) job.seed       = std::stoull( args[6] );
+   }
+   catch ( std::exception const & ) {
+      return {};
    }
-                                               // default values:
-   Str  filename    = argc >2?           argv[2]  : "output.png";
-   U32  side        = argc >3? std::stoi(argv[3]) :          512;
-   U32  cell_count  = argc >4? std::stoi(argv[4]) :         1024;
-   F32  weight_min  = argc >5? std::stof(argv[5]) :         1.0f;
-   F32  weight_max  = argc >6? std::stof(argv[6]) :         1.0f;
+   if ( args.size() > 7 )
+      return {};
+   return job;
+}
+
+// reads one job per line in the positional argument order of _main; blank lines and '#' comments are skipped
+Opt<Vec<MapJob>> load_job_manifest( Str const &path ) {
+   std::ifstream file( path );
+   if ( not file )
+      return {};
+   Vec<MapJob> jobs;
+   for ( Str line;  std::getline(file, line); ) {
+      line = line.substr( 0, line.find('#') );
+      std::istringstream words( line );
+      Vec<Str> args { std::istream_iterator<Str>(words), std::istream_iterator<Str>() };
+      if ( args.empty() )
+         continue;
+      auto maybe_job = parse_map_job( args );
+      if ( not maybe_job ) {
+         std::fprintf( stderr, "Invalid job in %s: %s\n", path.c_str(), line.c_str() );
+         return {};
+      }
+      jobs.push_back( std::move(maybe_job.value()) );
+   }
+   return jobs;
+}
+
+// the stages run_map_job reports to a GenerationMonitor
+Size constexpr map_job_stage_count = 4;
+
+// With a monitor, every stage is reported to it, the cells are computed progressively (a coarse
+// preview first, see Voronoi::toMapProgressive) and published after every pass, the regions are
+// published once grown, and the job stops early (returning false) when a stop is requested.
+Bool run_map_job( MapJob const &job, MapJobContext &context, ThreadPool &thread_pool = ThreadPool::shared(),
+                  GenerationMonitor *monitor = nullptr ) {
+   DV_PROFILE_ZONE( "run_map_job" );
+   auto const begin_stage = [&]( char const *name ) {
+      if ( not monitor )
+         return true;
+      if ( monitor->is_stop_requested() )
+         return false;
+      monitor->begin_stage( name );
+      return true;
+   };
+   auto const end_stage = [&]( U64 pixels, U64 cells ) {
+      if ( monitor )
+         monitor->end_stage( pixels, cells );
+   };
+   U64 const pixel_count = U64( job.side ) * job.side;
 
    RNG::Engine rng_engine;
-   if ( argc >7 )
-      rng_engine = RNG::Engine { std::stoul(argv[4]) };
-   assert( argc < 9 );
-
-   RNG::Real<F32>  rng_weight   { rng_engine, weight_min, weight_max };
-   RNG::Real<F32>  rng_axis_pos { rng_engine, .0f, F32(side) };
-   Voronoi<true> v { V2f( side, side ), cell_count };
-   for ( auto i = 0;  i < cell_count;  ++i ) {
-      V2f pos    = { rng_axis_pos(), rng_axis_pos() };
-      F32 weight = rng_weight();
-      if constexpr ( isDebugging )
-         printf( "Creating centre node i %d at (%3.3f,%3.3f) with weight: %2.1f\n", i, pos.x, pos.y, weight );
-      v.addCentre( pos, weight );
+   if ( job.seed )
+      rng_engine = RNG::Engine { job.seed.value() };
+
+   auto &v = context.voronoi;
+   if ( not begin_stage("place_centres") )
+      return false;
+   { // draw all centre coordinates and weights in bulk
+      DV_PROFILE_ZONE( "place_centres" );
+      auto  centre_rng = RNG::CounterEngine::from( rng_engine );
+      auto &positions  = context.centre_positions;
+      auto &weights    = context.centre_weights;
+      positions.resize( 2 * job.cell_count );
+      weights.resize( job.cell_count );
+      RNG::fill_real( centre_rng, positions, .0f, F32(job.side) );
+      RNG::fill_real( centre_rng, weights, job.weight_min, job.weight_max );
+
+      v.reset( V2f( job.side, job.side ) );
+      for ( auto i = 0U;  i < job.cell_count;  ++i ) {
+         V2f pos    = { positions[2*i], positions[2*i + 1] };
+         F32 weight = weights[i];
+         ur::log::debug( "Creating centre node i %u at (%3.3f,%3.3f) with weight: %2.1f", i, pos.x, pos.y, weight );
+         v.addCentre( pos, weight );
+      }
    }
-   V2u dimensions{ side, side };
-   auto map = [&]() {
-      switch ( distance_function ) {
+   end_stage( 0, job.cell_count );
+
+   auto &map = context.map;
+   if ( not begin_stage("to_map") )
+      return false;
+   map.resize( V2u( job.side, job.side ) );
+   if ( monitor ) { // refine a coarse preview in passes (same total work)
+      auto const on_pass = [&]( Map<Idx> const &pass_map, Size step ) {
+         monitor->publish_preview( pass_map );
+         monitor->set_stage_progress( 1.0f / F32(step * step) );
+         return not monitor->is_stop_requested();
+      };
+      Bool is_complete = false;
+      switch ( job.distance_function ) {
          default: // make Euclidean distance the default
-         case DistanceFunction::euclidean: return v.toMap<EuclideanDistance>( dimensions );
-         case DistanceFunction::manhattan: return v.toMap<ManhattanDistance>( dimensions );
-         case DistanceFunction::chebychev: return v.toMap<ChebychevDistance>( dimensions );
-         case DistanceFunction::weirdness: return v.toMap<WeirdnessDistance>( dimensions );
+         case DistanceFunction::euclidean: is_complete = v.toMapProgressive<EuclideanDistance>( map, on_pass, thread_pool ); break;
+         case DistanceFunction::manhattan: is_complete = v.toMapProgressive<ManhattanDistance>( map, on_pass, thread_pool ); break;
+         case DistanceFunction::chebychev: is_complete = v.toMapProgressive<ChebychevDistance>( map, on_pass, thread_pool ); break;
+         case DistanceFunction::weirdness: is_complete = v.toMapProgressive<WeirdnessDistance>( map, on_pass, thread_pool ); break;
       }
-   }();
-   auto growth_targets = generate_growth_targets(v, .33f, 2, 13, rng_engine );
-   grow_regions<true>( v, map, growth_targets, rng_engine );
+      if ( not is_complete )
+         return false;
+   }
+   else switch ( job.distance_function ) {
+      default: // make Euclidean distance the default
+      case DistanceFunction::euclidean: v.toMap<EuclideanDistance>( map ); break;
+      case DistanceFunction::manhattan: v.toMap<ManhattanDistance>( map ); break;
+      case DistanceFunction::chebychev: v.toMap<ChebychevDistance>( map ); break;
+      case DistanceFunction::weirdness: v.toMap<WeirdnessDistance>( map ); break;
+   }
+   end_stage( pixel_count, job.cell_count );
+
+   if ( not begin_stage("grow_regions") )
+      return false;
+   auto growth_targets = generate_growth_targets( v, .33f, 2, 13, rng_engine, context.workspace );
+   Fun<Bool> is_stop_requested;
+   if ( monitor )
+      is_stop_requested = [monitor] { return monitor->is_stop_requested(); };
+   auto regions = grow_regions_parallel<true>( v, map, growth_targets, rng_engine, context.workspace, thread_pool, is_stop_requested );
+   if ( monitor and monitor->is_stop_requested() ) // the regions are incomplete
+      return false;
+   regions.materialize_into( map, thread_pool );
+   end_stage( pixel_count, job.cell_count );
+   if ( monitor )
+      monitor->publish_preview( map );
 
-   map2png( map, filename );
-   return 0;
+   if ( not begin_stage("save_png") )
+      return false;
+   Bool const is_saved = map2png( map, job.filename, Z_DEFAULT_COMPRESSION, thread_pool );
+   end_stage( pixel_count, 0 );
+   return is_saved;
 }
 
+// Runs every job of a manifest. Each worker owns a MapJobContext and pulls jobs until none are
+// left; within a job everything runs serially, which is cheaper than splitting small maps.
+// The output of a job does not depend on the worker that ran it.
+I32 run_batch( Str const &manifest_path, Size worker_count=0 ) {
+   auto maybe_jobs = load_job_manifest( manifest_path );
+   if ( not maybe_jobs )
+      return 1;
+   auto const       &jobs = maybe_jobs.value();
+   ThreadPool        workers { worker_count };
+   ThreadPool        serial  { 1 };
+   Vec<MapJobContext> contexts( workers.thread_count() );
+   std::atomic<Size>  next_job    = 0,
+                      failed_jobs = 0;
+   workers.parallel_for( contexts.size(), [&]( Idx worker ) {
+      for ( Idx job;  (job = next_job++) < jobs.size(); ) {
+         if ( not run_map_job(jobs[job], contexts[worker], serial) ) {
+            std::fprintf( stderr, "Failed to write %s\n", jobs[job].filename.c_str() );
+            ++failed_jobs;
+         }
+      }
+   } );
+   return failed_jobs == 0? 0 : 1;
+}
+
+// usage: _main [distance function] [filename] [side] [cell count] [weight min] [weight max] [seed]
+//        _main --batch <manifest> [worker count]
+I32 _main( I32 const argc, char const *argv[] ) {
+   Vec<Str> args( argv + 1, argv + argc );
+   // with DV1478_PROFILE: prints the per-stage summary and writes a Chrome trace next to the output;
+   // with DV1478_TRACK_ALLOCATIONS: prints the per-stage allocations and the memory high-water marks
+   auto const report_profile = []( Str const &trace_path ) {
+      if constexpr ( Profiler::is_enabled ) {
+         Profiler::print_summary();
+         if ( not Profiler::write_chrome_trace(trace_path) )
+            std::fprintf( stderr, "Failed to write %s\n", trace_path.c_str() );
+      }
+      AllocationTracker::print_report();
+   };
+   auto const print_usage = [argv] {
+      std::fprintf( stderr, "usage: %s [distance function] [filename] [side] [cell count] [weight min] [weight max] [seed]\n"
+                            "       %s --batch <manifest> [worker count]\n"
+                            "valid distance functions are: Euclidean, Manhattan, Chebychev, Weirdness\n", argv[0], argv[0] );
+   };
+   if ( not args.empty() and args[0] == "--batch" ) {
+      Size worker_count = 0;
+      Bool is_valid     = args.size() == 2 or args.size() == 3;
+      if ( is_valid and args.size() == 3 ) {
+         auto const *const end = args[2].data() + args[2].size();
+         auto const [last, error] = std::from_chars( args[2].data(), end, worker_count );
+         is_valid = error == std::errc() and last == end;
+      }
+      if ( not is_valid ) {
+         print_usage();
+         return 2;
+      }
+      I32 const result = run_batch( args[1], worker_count );
+      report_profile( args[1] + ".trace.json" );
+      ur::log::flush();
+      return result;
+   }
+   auto maybe_job = parse_map_job( args );
+   if ( not maybe_job ) {
+      print_usage();
+      return 2;
+   }
+   MapJobContext context;
+   Bool const is_ok = run_map_job( maybe_job.value(), context );
+   report_profile( maybe_job->filename + ".trace.json" );
+   ur::log::flush();
+   return is_ok? 0 : 1;
+}
+
+
+// The ImGui front end: edits a MapJob, runs it on a background thread and shows its stages,
+// throughput, memory use and a preview while it runs. Drawing never waits for the generator.
+class GeneratorWindow {
+public:
+   ~GeneratorWindow() {
+      m_monitor.request_stop(); // the job polls it within to_map and grow_regions too; m_worker joins it
+   }
+
+   void draw() {
+      if ( auto snapshot = m_monitor.try_snapshot() )
+         m_snapshot = std::move( snapshot.value() );
+      update_texture();
+      Bool const is_running = m_monitor.is_running();
+
+      ImGui::BeginDisabled( is_running );
+      Arr<char const*,4> constexpr names { "Manhattan", "Euclidean", "Chebychev", "Weirdness" }; // DistanceFunction order
+      I32 distance_function = static_cast<I32>( m_job.distance_function );
+      if ( ImGui::Combo("distance", &distance_function, names.data(), I32(names.size())) )
+         m_job.distance_function = static_cast<DistanceFunction>( distance_function );
+      ImGui::InputText( "output", m_filename.data(), m_filename.size() );
+      ImGui::InputScalar( "side", ImGuiDataType_U32, &m_job.side );
+      ImGui::InputScalar( "cells", ImGuiDataType_U32, &m_job.cell_count );
+      ImGui::InputFloat( "weight min", &m_job.weight_min );
+      ImGui::InputFloat( "weight max", &m_job.weight_max );
+      ImGui::Checkbox( "fixed seed", &m_is_seeded );
+      if ( m_is_seeded ) {
+         ImGui::SameLine();
+         ImGui::InputScalar( "seed", ImGuiDataType_U64, &m_seed );
+      }
+      if ( ImGui::Button("Generate") )
+         start();
+      ImGui::EndDisabled();
+      ImGui::SameLine();
+      ImGui::BeginDisabled( not is_running or m_monitor.is_stop_requested() );
+      if ( ImGui::Button("Cancel") )
+         m_monitor.request_stop();
+      ImGui::EndDisabled();
+
+      draw_progress();
+   #ifndef DV1478_HAS_OPENGL_PREVIEW
+      ImGui::TextUnformatted( "(the preview needs an OpenGL renderer)" );
+   #endif
+      if ( m_texture ) {
+         F32 const side = std::min( ImGui::GetContentRegionAvail().x, ImGui::GetContentRegionAvail().y );
+         F32 const scale = side / std::max( m_texture_dimensions.x, m_texture_dimensions.y );
+         ImGui::Image( (ImTextureID)(intptr_t) m_texture, ImVec2(m_texture_dimensions.x * scale, m_texture_dimensions.y * scale) );
+      }
+   }
+
+   // (while the GL context still exists)
+   void release_texture() {
+   #ifdef DV1478_HAS_OPENGL_PREVIEW
+      if ( m_texture )
+         glDeleteTextures( 1, &m_texture );
+      m_texture = 0;
+   #endif
+   }
+
+private:
+   MapJob                       m_job;
+   Arr<char,256>                m_filename { "output.png" };
+   Bool                         m_is_seeded = false;
+   U64                          m_seed      = 1478;
+   MapJobContext                m_context;
+   GenerationMonitor            m_monitor;
+   GenerationMonitor::Snapshot  m_snapshot;
+   GenerationMonitor::Preview   m_preview;
+   U32                          m_texture = 0;
+   V2u                          m_texture_dimensions { 0, 0 };
+   std::jthread                 m_worker; // last, so it is joined before the members it uses go away
+
+   void start() {
+      if ( m_worker.joinable() )
+         m_worker.join(); // the previous job has finished (the button is disabled until then)
+      m_job.filename   = m_filename.data();
+      m_job.side       = std::max( m_job.side, 1U );
+      m_job.cell_count = std::max( m_job.cell_count, 1U );
+      m_job.weight_max = std::max( m_job.weight_min, m_job.weight_max );
+      m_job.seed       = m_is_seeded? Opt<U64>(m_seed) : Opt<U64>();
+      m_monitor.start( map_job_stage_count );
+      m_worker = std::jthread( [this, job = m_job] {
+         Bool const is_ok = run_map_job( job, m_context, ThreadPool::shared(), &m_monitor );
+         if ( not is_ok and not m_monitor.is_stop_requested() )
+            ur::log::error( "Failed to write %s", job.filename );
+         m_monitor.finish( is_ok );
+      } );
+   }
+
+   void draw_progress() {
+      auto const &snapshot = m_snapshot;
+      char label[64];
+      if ( snapshot.is_running and not snapshot.stages.empty() )
+         std::snprintf( label, sizeof label, "%s (%.1f s)", snapshot.stages.back().name, snapshot.seconds );
+      else if ( not snapshot.stages.empty() )
+         std::snprintf( label, sizeof label, "%s in %.2f s", snapshot.is_ok? "done" : "stopped", snapshot.seconds );
+      else std::snprintf( label, sizeof label, "idle" );
+      ImGui::ProgressBar( snapshot.progress(), ImVec2(-1.0f, .0f), label );
+
+      if ( ImGui::BeginTable("stages", 3) ) {
+         ImGui::TableSetupColumn( "stage" );
+         ImGui::TableSetupColumn( "ms" );
+         ImGui::TableSetupColumn( "throughput" );
+         ImGui::TableHeadersRow();
+         for ( auto const &stage : snapshot.stages ) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted( stage.name );
+            ImGui::TableNextColumn();
+            ImGui::Text( stage.is_done? "%.1f" : "%.1f ...", stage.seconds * 1e3 );
+            ImGui::TableNextColumn();
+            if ( stage.is_done and stage.seconds > 0 and stage.pixels )
+               ImGui::Text( "%.2f Mpx/s", stage.pixels / stage.seconds * 1e-6 );
+            else if ( stage.is_done and stage.seconds > 0 and stage.cells )
+               ImGui::Text( "%.0f cells/s", stage.cells / stage.seconds );
+         }
+         ImGui::EndTable();
+      }
+
+      F64 constexpr MiB = 1024.0 * 1024.0;
+      if constexpr ( AllocationTracker::is_enabled )
+         ImGui::Text( "heap %.1f MiB (peak %.1f MiB)", snapshot.heap_bytes / MiB, AllocationTracker::peak_bytes() / MiB );
+      ImGui::Text( "RSS %.1f MiB (peak %.1f MiB)", snapshot.rss_bytes / MiB, snapshot.peak_rss_bytes / MiB );
+   }
+
+   void update_texture() {
+   #ifdef DV1478_HAS_OPENGL_PREVIEW
+      if ( not m_monitor.try_take_preview(m_preview) )
+         return;
+      if ( not m_texture ) {
+         glGenTextures( 1, &m_texture );
+         glBindTexture( GL_TEXTURE_2D, m_texture );
+         glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+         glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      }
+      glBindTexture( GL_TEXTURE_2D, m_texture );
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, m_preview.dimensions.x, m_preview.dimensions.y, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, m_preview.pixels.data() );
+      m_texture_dimensions = m_preview.dimensions;
+   #endif
+   }
+};
 
 I32 main( I32, char** )
 {
-   HelloImGui::Run(
-      [] {             
-         // app code start    
-         ImGui::Text("Hello, world!");
-         // app code end
-      },               
-      { 640.f, 480.f }, // window dimensions
-      "Map Generator!"  // title
-     );
+   GeneratorWindow window;
+   HelloImGui::RunnerParams params;
+   params.appWindowParams.windowTitle         = "Map Generator!";
+   params.appWindowParams.windowGeometry.size = { 1024, 768 };
+   params.callbacks.ShowGui    = [&] { window.draw(); };
+   params.callbacks.BeforeExit = [&] { window.release_texture(); };
+   HelloImGui::Run( params );
 }
 